@@ -1,58 +1,833 @@
+// POSIX interfaces used below (clock_gettime, mmap, sockets) are not part of ISO C
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <limits.h>
 #include <time.h>
 #include <math.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Coordinate type, chosen at build time: 32-bit int by default, or -DRTREE_COORD_INT64,
+// -DRTREE_COORD_FLOAT or -DRTREE_COORD_DOUBLE. Areas, margins and squared distances are
+// computed in area_t, which is wide enough that they cannot overflow.
+#define COORD_INT32 0
+#define COORD_INT64 1
+#define COORD_FLOAT 2
+#define COORD_DOUBLE 3
+
+#if defined(RTREE_COORD_DOUBLE)
+typedef double coord_t;
+typedef double area_t;
+#define COORD_TYPE COORD_DOUBLE
+#define COORD_NAME "double"
+#define COORD_MIN (-HUGE_VAL)
+#define COORD_MAX HUGE_VAL
+#define AREA_MAX HUGE_VAL
+#define COORD_FORMAT "%g"
+#define COORD_SCAN "%lf"
+#elif defined(RTREE_COORD_FLOAT)
+typedef float coord_t;
+typedef double area_t;
+#define COORD_TYPE COORD_FLOAT
+#define COORD_NAME "float"
+#define COORD_MIN (-HUGE_VALF)
+#define COORD_MAX HUGE_VALF
+#define AREA_MAX HUGE_VAL
+#define COORD_FORMAT "%g"
+#define COORD_SCAN "%f"
+#elif defined(RTREE_COORD_INT64)
+typedef long long coord_t;
+typedef double area_t;        // Products of 64-bit spans need more range than any integer type
+#define COORD_TYPE COORD_INT64
+#define COORD_NAME "int64"
+#define COORD_MIN LLONG_MIN
+#define COORD_MAX LLONG_MAX
+#define AREA_MAX HUGE_VAL
+#define COORD_FORMAT "%lld"
+#define COORD_SCAN "%lld"
+#else
+typedef int coord_t;
+typedef long long area_t;     // Exact for any product of two 32-bit spans
+#define COORD_TYPE COORD_INT32
+#define COORD_NAME "int32"
+#define COORD_MIN INT_MIN
+#define COORD_MAX INT_MAX
+#define AREA_MAX LLONG_MAX
+#define COORD_FORMAT "%d"
+#define COORD_SCAN "%d"
+#endif
+
+#define COORD_IS_INTEGER (COORD_TYPE == COORD_INT32 || COORD_TYPE == COORD_INT64)
+#define BOX_SCAN COORD_SCAN " " COORD_SCAN " " COORD_SCAN " " COORD_SCAN  // min_x min_y max_x max_y
+#define POINT_FORMAT "(" COORD_FORMAT ", " COORD_FORMAT ")"
+
+// Vector kernels for the per-node overlap test; define RTREE_NO_SIMD to force the scalar path.
+// Each coordinate type gets its own compare; SSE2 has none for 64-bit integers, so those
+// are only vectorised with AVX2.
+#if !defined(RTREE_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define RTREE_USE_AVX2 1
+#if COORD_TYPE == COORD_INT32
+#define COORD_LANES 8
+#define VEC_SET1(v) _mm256_set1_epi32(v)
+#define VEC_LOAD(p) _mm256_load_si256((const __m256i *)(p))
+#define VEC_GT(a, b) _mm256_cmpgt_epi32(a, b)
+#define VEC_OR(a, b) _mm256_or_si256(a, b)
+#define VEC_MOVEMASK(v) _mm256_movemask_ps(_mm256_castsi256_ps(v))
+typedef __m256i coord_vec;
+#elif COORD_TYPE == COORD_INT64
+#define COORD_LANES 4
+#define VEC_SET1(v) _mm256_set1_epi64x(v)
+#define VEC_LOAD(p) _mm256_load_si256((const __m256i *)(p))
+#define VEC_GT(a, b) _mm256_cmpgt_epi64(a, b)
+#define VEC_OR(a, b) _mm256_or_si256(a, b)
+#define VEC_MOVEMASK(v) _mm256_movemask_pd(_mm256_castsi256_pd(v))
+typedef __m256i coord_vec;
+#elif COORD_TYPE == COORD_FLOAT
+#define COORD_LANES 8
+#define VEC_SET1(v) _mm256_set1_ps(v)
+#define VEC_LOAD(p) _mm256_load_ps(p)
+#define VEC_GT(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define VEC_OR(a, b) _mm256_or_ps(a, b)
+#define VEC_MOVEMASK(v) _mm256_movemask_ps(v)
+typedef __m256 coord_vec;
+#else
+#define COORD_LANES 4
+#define VEC_SET1(v) _mm256_set1_pd(v)
+#define VEC_LOAD(p) _mm256_load_pd(p)
+#define VEC_GT(a, b) _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define VEC_OR(a, b) _mm256_or_pd(a, b)
+#define VEC_MOVEMASK(v) _mm256_movemask_pd(v)
+typedef __m256d coord_vec;
+#endif
+#elif !defined(RTREE_NO_SIMD) && defined(__SSE2__) && COORD_TYPE != COORD_INT64
+#include <emmintrin.h>
+#define RTREE_USE_SSE2 1
+#if COORD_TYPE == COORD_INT32
+#define COORD_LANES 4
+#define VEC_SET1(v) _mm_set1_epi32(v)
+#define VEC_LOAD(p) _mm_load_si128((const __m128i *)(p))
+#define VEC_GT(a, b) _mm_cmpgt_epi32(a, b)
+#define VEC_OR(a, b) _mm_or_si128(a, b)
+#define VEC_MOVEMASK(v) _mm_movemask_ps(_mm_castsi128_ps(v))
+typedef __m128i coord_vec;
+#elif COORD_TYPE == COORD_FLOAT
+#define COORD_LANES 4
+#define VEC_SET1(v) _mm_set1_ps(v)
+#define VEC_LOAD(p) _mm_load_ps(p)
+#define VEC_GT(a, b) _mm_cmpgt_ps(a, b)
+#define VEC_OR(a, b) _mm_or_ps(a, b)
+#define VEC_MOVEMASK(v) _mm_movemask_ps(v)
+typedef __m128 coord_vec;
+#else
+#define COORD_LANES 2
+#define VEC_SET1(v) _mm_set1_pd(v)
+#define VEC_LOAD(p) _mm_load_pd(p)
+#define VEC_GT(a, b) _mm_cmpgt_pd(a, b)
+#define VEC_OR(a, b) _mm_or_pd(a, b)
+#define VEC_MOVEMASK(v) _mm_movemask_pd(v)
+typedef __m128d coord_vec;
+#endif
+#endif
+
+
+// Fanout and minimum fill are build-time parameters, e.g. gcc -DRTREE_MAX_ENTRIES=32 -DRTREE_MIN_FILL_PERCENT=40
+#ifndef RTREE_MAX_ENTRIES
+#define RTREE_MAX_ENTRIES 16
+#endif
+
+#ifndef RTREE_MIN_FILL_PERCENT
+#define RTREE_MIN_FILL_PERCENT 50
+#endif
+
+#if RTREE_MAX_ENTRIES < 4 || RTREE_MAX_ENTRIES > 64
+#error "RTREE_MAX_ENTRIES must be between 4 and 64"
+#endif
+
+#if RTREE_MIN_FILL_PERCENT < 10 || RTREE_MIN_FILL_PERCENT > 50
+#error "RTREE_MIN_FILL_PERCENT must be between 10 and 50"
+#endif
+
+#define MAX_ENTRIES RTREE_MAX_ENTRIES  // Maximum number of children per node
+
+#define MIN_ENTRIES ((MAX_ENTRIES * RTREE_MIN_FILL_PERCENT + 99) / 100) // Minimum number of children per non-root node
+
+#define CACHE_LINE_SIZE 64
+
+#define RSTAR_REINSERT_PERCENT 30 // Share of an overflowing R* node's entries that are reinserted
+
+#define RTREE_MAX_HEIGHT 32 // Deepest tree the iterative query engine can walk
+
+#define QUERY_BATCH_SIZE 256 // Results fetched per call when draining a cursor
 
+#define READER_STRIPES 64 // Reader counters per ConcurrentRTree indicator, one cache line each
 
-#define MAX_ENTRIES 4  // Maximum number of children per node
+#define READER_CHUNK_SIZE (1 << 20) // Bytes pulled from a sensor text file per read
+#define HISTORY_COLUMNS 3           // Humidity, pollution level and temperature
+#define HISTORY_BUCKET_STEPS 16     // Timesteps summarised by one history bucket
+#define STANDING_GRID_SLOTS 4096    // Hash slots of the grid that buckets standing queries
+#define STANDING_CELL_SIZE 64       // Default side of a standing-query grid cell
+#define STANDING_MAX_CELLS 1024     // Standing queries covering more cells are checked on every change
+#define HEATMAP_SIZE 128            // Cells per side of the heatmap written by option B
+#define HEATMAP_MIN_TEMPERATURE 30  // Temperature drawn at the cold end of the heatmap palette
+#define HEATMAP_MAX_TEMPERATURE 100 // Temperature drawn at the hot end of the heatmap palette
+#define BENCH_DEFAULT_SENSORS 100000   // Sensors in a --bench dataset unless --sensors is given
+#define BENCH_DEFAULT_OPERATIONS 10000 // Operations per --bench workload unless --operations is given
+#define BENCH_SENSOR_SPACING 100       // Mean distance between neighbouring sensors, as in sensors/
+#define BENCH_QUERY_HITS 100           // Sensors a benchmark range query returns on average (uniform data)
+#define BENCH_NEIGHBORS 10             // k of the benchmark nearest-neighbour queries
+#define BENCH_CLUSTERS 32              // Dense centres of a clustered dataset
+#define BENCH_FIRE_STEPS 5             // Timesteps applied by the benchmark update workload
+#define BENCH_MAX_RECORDS (INT_MAX / BENCH_FIRE_STEPS) // Largest --sensors plus --operations, so operation counts fit in an int
+#define SERVER_INPUT_SIZE (64 * 1024)  // Request bytes read per call; also the longest request accepted
+#define SERVER_FLUSH_BYTES (64 * 1024) // Buffered response bytes that force a write mid-batch
 
-#define MIN_ENTRIES (MAX_ENTRIES / 2) // Minimum number of children per non-root node
+#define SNAPSHOT_MAGIC "RTREESNP"
+#define SNAPSHOT_VERSION 6
+#define SNAPSHOT_PAGE_SIZE 4096 // Every snapshot section starts on a page boundary
+#define SNAPSHOT_FNV_BASIS 0xcbf29ce484222325ULL
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+#define POOL_SLAB_BYTES (64 * 1024) // Size of each slab handed out by an ObjectPool
+
+// Event counters for profiling, compiled in with -DRTREE_STATS. Without it STAT_ADD expands
+// to nothing and the query and update paths are unchanged.
+#ifdef RTREE_STATS
+#define STAT_ADD(field, n) (rtree_counters.field += (n))
+#define STAT_TIMER_START double stat_timer_start = monotonicSeconds()
+#define STAT_TIMER_STOP recordQueryTime(monotonicSeconds() - stat_timer_start)
+#else
+#define STAT_ADD(field, n) ((void)0)
+#define STAT_TIMER_START ((void)0)
+#define STAT_TIMER_STOP ((void)0)
+#endif
 
 
 
 // Define a bounding box to cover sensor points
 typedef struct BoundingBox {
-    int min_x;
-    int min_y;
-    int max_x;
-    int max_y;
+    coord_t min_x;
+    coord_t min_y;
+    coord_t max_x;
+    coord_t max_y;
 } BoundingBox;
 
 // Define a sensor point with environmental data
 typedef struct SensorNode {
-    int x;
-    int y;
+    coord_t x;
+    coord_t y;
     int humidity;
     int PollutionLevel;
     int temperature;
+    struct RTreeNode *leaf;   // Leaf holding the sensor, set whenever it is placed in one
 } SensorNode;
 
+// Summary of the readings of every sensor below a node
+typedef struct SensorAggregate {
+    long long count;
+    long long sum_humidity, sum_pollution, sum_temperature;
+    int min_humidity, max_humidity;
+    int min_pollution, max_pollution;
+    int min_temperature, max_temperature;
+} SensorAggregate;
+
+// Entry slots per node: MAX_ENTRIES plus one for the overflowing entry, rounded up so
+// every coordinate array fills whole cache lines (and whole SIMD registers)
+#define COORDS_PER_CACHE_LINE (CACHE_LINE_SIZE / sizeof(coord_t))
+#define NODE_SLOTS ((MAX_ENTRIES + 1 + COORDS_PER_CACHE_LINE - 1) / COORDS_PER_CACHE_LINE * COORDS_PER_CACHE_LINE)
 
 // Define an R-tree node (internal or leaf)
 typedef struct RTreeNode {
     int is_leaf;              // 1 if leaf, 0 if internal node
-    BoundingBox bbox;         // Bounding box covering all children/sensors
-    struct RTreeNode **children;  // Child nodes (for internal nodes)
-    SensorNode **sensors;     // Sensors (for leaf nodes)
     int num_entries;          // Number of children/sensors in the node
+    BoundingBox bbox;         // Bounding box covering all children/sensors
     struct RTreeNode *parent; // Parent node (for backtracking during splits)
+    // Bounding boxes of the entries as a structure of arrays, so one pass can test them all
+    _Alignas(CACHE_LINE_SIZE) coord_t entry_min_x[NODE_SLOTS];
+    _Alignas(CACHE_LINE_SIZE) coord_t entry_min_y[NODE_SLOTS];
+    _Alignas(CACHE_LINE_SIZE) coord_t entry_max_x[NODE_SLOTS];
+    _Alignas(CACHE_LINE_SIZE) coord_t entry_max_y[NODE_SLOTS];
+    // Entries are stored inline; the extra slot holds the overflowing entry until the node is split
+    union {
+        struct RTreeNode *children[NODE_SLOTS];  // Child nodes (for internal nodes)
+        SensorNode *sensors[NODE_SLOTS];         // Sensors (for leaf nodes)
+        BoundingBox *zones[NODE_SLOTS];          // Zones (for leaves of a temporary join tree)
+    };
+    SensorAggregate aggregate;                   // Readings of the whole subtree, kept current with the boxes
 } RTreeNode;
 
+// Slab header; objects are carved out of the memory that follows it
+typedef struct PoolSlab {
+    struct PoolSlab *next;
+} PoolSlab;
+
+// Fixed-size object pool: bump allocation from large slabs plus a free list for reuse
+typedef struct ObjectPool {
+    size_t object_size;       // Size of each object, rounded up for alignment
+    size_t alignment;         // Alignment of every object (and of the slabs themselves)
+    size_t slab_header;       // Bytes reserved at the start of each slab for the header
+    int objects_per_slab;     // Objects carved out of each slab
+    PoolSlab *slabs;          // All slabs owned by the pool
+    unsigned char *cursor;    // Next unused object in the newest slab
+    int remaining;            // Unused objects left behind the cursor
+    void *free_list;          // Released objects, linked through their first word
+} ObjectPool;
+
+// Insertion and split policy of a tree, fixed when the tree is created
+typedef enum SplitPolicy {
+    SPLIT_LINEAR,             // Guttman's linear-cost split
+    SPLIT_QUADRATIC,          // Guttman's quadratic-cost split
+    SPLIT_RSTAR               // R*-tree: overlap-minimising choose-subtree, margin-based split, forced reinsertion
+} SplitPolicy;
+
+#define DEFAULT_SPLIT_POLICY SPLIT_RSTAR
+
+// An entry being redistributed by a split: its box and its child or sensor
+typedef struct SplitEntry {
+    BoundingBox bbox;
+    void *item;
+} SplitEntry;
+
+// Open-addressing hash index from sensor coordinates to sensors (linear probing)
+typedef struct SensorIndex {
+    SensorNode **slots;       // NULL marks an empty slot
+    size_t capacity;          // Always a power of two
+    size_t count;
+    int owns_slots;           // 0 if slots live inside a mapped snapshot
+} SensorIndex;
+
+// Growable byte array holding one column of a sensor's history
+typedef struct ByteColumn {
+    unsigned char *bytes;
+    uint32_t length;
+    uint32_t capacity;
+} ByteColumn;
+
+// Summary of HISTORY_BUCKET_STEPS consecutive samples of one sensor; the first sample of a
+// bucket is stored as a delta from 0 so decoding can start at any bucket
+typedef struct HistoryBucket {
+    uint32_t offset[HISTORY_COLUMNS];  // Start of the bucket in each column
+    int min_value[HISTORY_COLUMNS];    // Over the present samples only
+    int max_value[HISTORY_COLUMNS];
+    uint32_t present;                  // Bit j set if sample j was recorded, clear for a gap
+} HistoryBucket;
+
+_Static_assert(HISTORY_BUCKET_STEPS <= 32, "a history bucket's presence bits must fit in 32 bits");
+
+// Time series of one sensor's readings: each column is a run of zigzag varint deltas
+typedef struct SensorSeries {
+    coord_t x, y;
+    int first_step;           // Timestep of the first sample (0 = first dataset)
+    int num_steps;
+    int last_value[HISTORY_COLUMNS];
+    ByteColumn columns[HISTORY_COLUMNS];
+    HistoryBucket *buckets;
+    int bucket_capacity;
+} SensorSeries;
+
+// Readings of every sensor at every loaded dataset, keyed by sensor coordinates
+typedef struct SensorHistory {
+    SensorSeries *series;
+    int num_series;
+    int series_capacity;
+    int *slots;               // Open-addressing map from (x, y) to series index + 1 (0 = empty)
+    size_t slot_capacity;
+    int num_steps;            // Timesteps recorded so far
+} SensorHistory;
+
+// A registered region query, optionally watching a temperature threshold
+typedef struct StandingQuery {
+    BoundingBox region;
+    int has_threshold;
+    int threshold;            // Sensors at or above it count as over the threshold
+    int active;
+} StandingQuery;
+
+// What happened to a sensor with respect to a standing query
+typedef enum StandingEventType {
+    STANDING_ENTER,           // Sensor added inside the region
+    STANDING_EXIT,            // Sensor removed from inside the region
+    STANDING_ABOVE,           // Temperature rose to the threshold or above
+    STANDING_BELOW            // Temperature fell below the threshold
+} StandingEventType;
+
+// One change notification; the sensor is copied because a removed sensor no longer exists
+typedef struct StandingEvent {
+    int query_id;
+    StandingEventType type;
+    SensorNode sensor;
+} StandingEvent;
+
+// Growable list of standing query ids
+typedef struct QueryList {
+    int *ids;
+    int count;
+    int capacity;
+} QueryList;
+
+// Standing queries of a tree, bucketed by a hashed uniform grid, and the events not yet fetched
+typedef struct StandingQuerySet {
+    StandingQuery *queries;
+    int num_queries;
+    int query_capacity;
+    coord_t cell_size;
+    QueryList cells[STANDING_GRID_SLOTS];
+    QueryList oversized;      // Queries too large to register cell by cell
+    StandingEvent *events;
+    int num_events;
+    int event_capacity;
+} StandingQuerySet;
+
+// Kind of change reported to the standing queries
+typedef enum SensorChange {
+    SENSOR_ADDED,
+    SENSOR_REMOVED,
+    SENSOR_UPDATED
+} SensorChange;
+
+// An R-tree together with the pools that own its nodes and sensors
+typedef struct RTree {
+    RTreeNode *root;
+    ObjectPool node_pool;
+    ObjectPool sensor_pool;
+    SensorIndex index;        // Every sensor in the tree, keyed by (x, y)
+    SplitPolicy policy;
+    unsigned int reinserted_levels; // Levels (bit 0 = leaves) already given R* forced reinsertion in this insert
+    void *mapping;            // Snapshot the tree was opened from (NULL if built in memory)
+    size_t mapping_size;
+    SensorHistory *history;   // Per-sensor time series, NULL unless temporal mode is on
+    StandingQuerySet *standing; // Registered standing queries, NULL if there are none
+} RTree;
+
+// Buffered reader for sensor text files: "x y humidity pollution temperature" per line
+typedef struct SensorReader {
+    FILE *file;
+    const char *path;
+    char *buffer;             // Holds READER_CHUNK_SIZE bytes plus the carried-over partial line
+    size_t capacity;
+    size_t length;            // Valid bytes in buffer
+    size_t position;          // Start of the next unparsed line
+    int at_eof;
+    long line;                // Number of the last line handed out, for error messages
+    long errors;              // Malformed rows skipped so far
+} SensorReader;
+
+// Snapshot file header. The file holds page-aligned sections of node images, sensor images
+// and index slots; every pointer is stored as a file offset (0 for NULL).
+typedef struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;      // SNAPSHOT_BYTE_ORDER as written by the producing machine
+    uint32_t max_entries;     // Build parameters the node images depend on
+    uint32_t node_slots;
+    uint32_t node_size;
+    uint32_t sensor_size;     // Stride of the sensor images
+    uint32_t split_policy;
+    uint32_t coord_type;      // COORD_TYPE of the producing build
+    uint64_t node_count;
+    uint64_t node_offset;
+    uint64_t sensor_count;
+    uint64_t sensor_offset;
+    uint64_t index_capacity;
+    uint64_t index_offset;
+    uint64_t root_offset;
+    uint64_t file_size;
+    uint64_t node_checksum;   // Section checksums, see snapshotSectionChecksum
+    uint64_t sensor_checksum;
+    uint64_t index_checksum;
+    uint64_t checksum;        // FNV-1a of the header with this field zeroed
+} SnapshotHeader;
+
+_Static_assert(sizeof(void *) == sizeof(uint64_t), "snapshot offsets are swizzled into 64-bit pointers");
+
+// Attribute predicate applied to candidate sensors during a query; all bounds are inclusive
+typedef struct SensorFilter {
+    int min_humidity, max_humidity;
+    int min_pollution, max_pollution;
+    int min_temperature, max_temperature;
+} SensorFilter;
+
+// Resumable range or radius query: an explicit stack of nodes with the entries each still has to visit
+typedef struct QueryCursor {
+    BoundingBox query_box;                   // Query box, or the square around the circle of a radius query
+    int is_circle;                           // 1 if only sensors within radius of the centre match
+    coord_t center_x, center_y;
+    area_t radius_sq;
+    int has_filter;                          // 1 if filter must hold for every returned sensor
+    SensorFilter filter;
+    int depth;                               // Number of frames on the stack
+    RTreeNode *stack_node[RTREE_MAX_HEIGHT];
+    uint64_t stack_mask[RTREE_MAX_HEIGHT];   // Overlapping entries of each frame not yet visited
+} QueryCursor;
+
+// Entry of a best-first search queue: a node or a sensor keyed by its distance (or another priority)
+typedef struct HeapItem {
+    area_t key;
+    void *item;
+    int is_sensor;            // 1 if item is a SensorNode, 0 if it is an RTreeNode
+} HeapItem;
+
+// Binary min-heap of HeapItems
+typedef struct MinHeap {
+    HeapItem *items;
+    int size;
+    int capacity;
+} MinHeap;
+
+// One result of a nearest-neighbour search
+typedef struct NeighborResult {
+    SensorNode *sensor;
+    area_t dist_sq;           // Squared distance from the query point
+} NeighborResult;
+
+// Results of a batch of range queries: the hits of query q are sensors[offsets[q] .. offsets[q + 1])
+typedef struct MultiQueryResult {
+    int num_queries;
+    int num_results;
+    int *offsets;             // num_queries + 1 prefix offsets into sensors
+    SensorNode **sensors;     // Hits of all queries, grouped by query
+} MultiQueryResult;
+
+// Working state for one batched traversal
+typedef struct MultiQueryScratch {
+    BoundingBox *queries;
+    int num_queries;
+    int *active;              // Active query lists, num_queries slots per tree level
+    uint64_t *masks;          // Overlap masks of the active queries, num_queries slots per tree level
+    int *hit_query;           // Query index of each (query, sensor) hit in traversal order
+    SensorNode **hit_sensor;
+    int num_hits;
+    int hit_capacity;
+} MultiQueryScratch;
+
+// What packLevel is packing: sensors or zones into leaves, or nodes into internal nodes
+typedef enum PackKind {
+    PACK_SENSORS,
+    PACK_ZONES,
+    PACK_NODES
+} PackKind;
+
+// One entry of a node as seen by the plane sweep of a spatial join
+typedef struct SweepEntry {
+    BoundingBox box;
+    int index;                // Entry slot in its node
+} SweepEntry;
+
+// Sensor pairs found by joining two sensor trees: (left[i], right[i])
+typedef struct SensorPairs {
+    SensorNode **left;
+    SensorNode **right;
+    int count;
+    int capacity;
+} SensorPairs;
+
+// Working state for one synchronized traversal of two trees
+typedef struct JoinScratch {
+    coord_t distance;         // Left boxes are grown by this much before they are tested
+    BoundingBox *zones;       // Zone array when the right tree indexes zones, NULL for a sensor join
+    MultiQueryScratch *hits;  // (zone, sensor) hits of a zone join
+    SensorPairs *pairs;       // Sensor pairs of a tree join
+} JoinScratch;
+
+// Value drawn for each heatmap cell
+typedef enum RasterMode {
+    RASTER_MEAN,
+    RASTER_MAX
+} RasterMode;
+
+// Temperature grid over a box. Cell (column, row) covers an equal share of the extent;
+// row 0 is the bottom of the box.
+typedef struct Raster {
+    BoundingBox extent;
+    int columns;
+    int rows;
+    long long *count;         // Sensors in each cell
+    long long *sum;           // Sum of their temperatures
+    int *max;                 // Highest of their temperatures
+} Raster;
+
+// Spatial layout of a synthetic benchmark dataset
+typedef enum SensorDistribution {
+    DIST_UNIFORM,             // Sensors spread evenly over the field, with random readings
+    DIST_CLUSTERED,           // Sensors gathered around a few dense centres
+    DIST_FIRE                 // Even spread with a fire growing outwards from the centre, like sensors/
+} SensorDistribution;
+
+// Parameters of a --bench run
+typedef struct BenchConfig {
+    int num_sensors;
+    int num_operations;       // Operations per query, insert and delete workload
+    SensorDistribution distribution;
+    SplitPolicy policy;
+    uint64_t seed;
+} BenchConfig;
+
+// Timings of one benchmark workload
+typedef struct BenchWorkload {
+    const char *name;
+    double *latencies;        // Seconds taken by each operation
+    int count;
+    int capacity;
+    double seconds;           // Wall time of the whole workload
+    long long results;        // Sensors returned, as a checksum across runs
+} BenchWorkload;
+
+// What the server does after a request
+typedef enum ServerAction {
+    SERVER_CONTINUE,
+    SERVER_CLOSE,             // QUIT: close this client's connection
+    SERVER_SHUTDOWN           // SHUTDOWN: stop serving altogether
+} ServerAction;
+
+// Request and response buffers of one server client
+typedef struct ServerConnection {
+    int in_fd;
+    int out_fd;
+    char *input;              // SERVER_INPUT_SIZE bytes of received requests
+    size_t input_length;      // Valid bytes in input
+    size_t input_position;    // Start of the next unhandled request
+    char *output;             // Responses not yet written
+    size_t output_length;
+    size_t output_capacity;
+    int closed;               // Set once writing to the client has failed
+    int reading;              // Set inside a read section, which must not wait on the client
+} ServerConnection;
+
+// A write request, applied by applyConcurrentWrite to each instance of the served tree in turn.
+// Both instances hold the same sensors beforehand, so both applications give the same count.
+typedef struct ServerWrite {
+    SensorNode record;        // INSERT: the new sensor; DELETE: its position
+    SensorNode *records;      // UPDATE: the rows of the sensor file
+    int num_records;
+    RTree *loaded[2];         // LOAD: one copy of the snapshot for each instance
+    int applied;              // Instances written so far
+    int count;                // Sensors added, deleted, updated or loaded
+} ServerWrite;
+
+// Shape of a tree, gathered on demand by collectTreeStats. Levels are numbered from the
+// leaves (0) up. Overlap and dead space are summed areas over the nodes of a level.
+typedef struct TreeStats {
+    int height;
+    size_t nodes;
+    size_t sensors;
+    size_t level_nodes[RTREE_MAX_HEIGHT];
+    size_t level_entries[RTREE_MAX_HEIGHT];
+    double level_overlap[RTREE_MAX_HEIGHT];    // Area shared by pairs of sibling entries
+    double level_dead_space[RTREE_MAX_HEIGHT]; // Area of a node covered by none of its entries
+} TreeStats;
+
+#ifdef RTREE_STATS
+// Events counted since the last resetRTreeCounters. Counters are per thread, so concurrent
+// readers never contend on them; each thread sees only its own queries.
+typedef struct RTreeCounters {
+    unsigned long long queries;
+    double query_seconds;          // Time spent inside query calls
+    double max_query_seconds;
+    unsigned long long node_visits;     // Nodes whose entries a query tested
+    unsigned long long entries_scanned; // Entries tested by those visits
+    unsigned long long false_positives; // Nodes entered because their box passed, holding no match
+    unsigned long long splits;
+    unsigned long long reinserts;       // R* forced reinsertions that took entries out of a node
+    unsigned long long merges;          // Underfull nodes dissolved and reinserted by a delete
+    unsigned long long pool_allocs;
+    unsigned long long pool_releases;
+    unsigned long long slab_allocs;     // Calls to the system allocator made by the pools
+} RTreeCounters;
+
+_Thread_local RTreeCounters rtree_counters;
+#endif
+
+// Working state for one delete traversal (CondenseTree). Nodes that fall below MIN_ENTRIES
+// are cut out of the tree and their entries reinserted once the traversal is done.
+typedef struct DeleteBatch {
+    int by_region;            // Delete everything inside region, otherwise the given sensors
+    BoundingBox region;
+    int deleted;
+    RTreeNode **orphans;
+    int *orphan_levels;       // Level of each orphaned node (0 = leaf)
+    int num_orphans;
+    int orphan_capacity;
+} DeleteBatch;
+
+// Striped count of readers inside one side of a ConcurrentRTree; each thread uses its own stripe
+typedef struct ReaderIndicator {
+    struct {
+        _Alignas(CACHE_LINE_SIZE) atomic_long count;
+    } stripes[READER_STRIPES];
+} ReaderIndicator;
+
+// Left-Right concurrency control: two identical trees, readers use one while the writer
+// updates the other, then the roles swap. Readers never block; writers are serialised.
+typedef struct ConcurrentRTree {
+    RTree *instances[2];
+    atomic_int left_right;        // Instance new readers are directed to
+    atomic_int version_index;     // Reader indicator new readers arrive on
+    ReaderIndicator readers[2];
+    pthread_mutex_t writer_lock;
+} ConcurrentRTree;
+
+// Handed out by beginConcurrentRead and given back to endConcurrentRead
+typedef struct ReadTicket {
+    int version;
+    int stripe;
+} ReadTicket;
+
+// A write applied to each instance of a ConcurrentRTree in turn
+typedef void (*TreeWriteOp)(RTree *tree, void *arg);
+
+// A client connection of the socket server, answered on its own thread
+typedef struct SocketClient {
+    struct SocketServer *server;
+    int fd;
+    struct SocketClient *next;
+} SocketClient;
+
+// Unix domain socket server: every client is served concurrently over one ConcurrentRTree
+typedef struct SocketServer {
+    ConcurrentRTree *ctree;
+    int listener;
+    pthread_mutex_t lock;     // Guards clients and shutting_down
+    pthread_cond_t idle;      // Signalled when the last client has left
+    SocketClient *clients;
+    int shutting_down;        // Set by the first SHUTDOWN request
+} SocketServer;
+
 // Function prototypes
+void initObjectPool(ObjectPool *pool, size_t object_size, size_t alignment);
+void *poolAlloc(ObjectPool *pool);
+void poolRelease(ObjectPool *pool, void *object);
+void destroyObjectPool(ObjectPool *pool);
+void initSensorIndex(SensorIndex *index);
+void destroySensorIndex(SensorIndex *index);
+void sensorIndexInsert(SensorIndex *index, SensorNode *sensor);
+void sensorIndexRemove(SensorIndex *index, SensorNode *sensor);
+SensorNode *sensorIndexFind(SensorIndex *index, coord_t x, coord_t y);
+RTree *createRTree(SplitPolicy policy);
+const char *splitPolicyName(SplitPolicy policy);
+int parseSplitPolicy(const char *name, SplitPolicy *policy);
+void destroyRTree(RTree *tree);
+int openSensorReader(SensorReader *reader, const char *path);
+int readSensorRecord(SensorReader *reader, SensorNode *record);
+void closeSensorReader(SensorReader *reader);
+RTree *loadSensorFile(const char *file_path, SplitPolicy policy);
+int updateSensorsFromFile(RTree *tree, const char *file_path);
+void enableSensorHistory(RTree *tree);
+void enableStandingQueries(RTree *tree, coord_t cell_size);
+void destroyStandingQueries(StandingQuerySet *set);
+int addStandingQuery(RTree *tree, BoundingBox *region, int has_threshold, int threshold);
+int removeStandingQuery(RTree *tree, int query_id);
+void notifyStandingQueries(StandingQuerySet *set, SensorNode *sensor, SensorChange change, int old_temperature);
+int fetchStandingEvents(RTree *tree, StandingEvent *events, int capacity);
+void destroySensorHistory(SensorHistory *history);
+void recordHistoryStep(RTree *tree);
+int sensorHistoryAt(RTree *tree, coord_t x, coord_t y, int step, SensorNode *result);
+int historyExceedances(RTree *tree, BoundingBox *query_box, int threshold, int first_step, int last_step,
+                       SensorNode **results, int capacity);
+int saveRTreeSnapshot(RTree *tree, const char *path);
+RTree *loadRTreeSnapshot(const char *path);
+SensorNode *findSensorAt(RTree *tree, coord_t x, coord_t y);
+SensorNode *createSensorNode(RTree *tree);
 SensorNode *searchSensorInRTree(RTreeNode *node, SensorNode *target);
-BoundingBox *createBoundingBox(int min_x, int min_y, int max_x, int max_y);
+BoundingBox *createBoundingBox(coord_t min_x, coord_t min_y, coord_t max_x, coord_t max_y);
 BoundingBox createBoundingBoxForSensor(SensorNode *sensor);
-RTreeNode *createRTreeNode(int is_leaf);
-int area(BoundingBox *bbox);
+RTreeNode *createRTreeNode(RTree *tree, int is_leaf);
 int overlaps(BoundingBox *a, BoundingBox *b);
 void expandToInclude(BoundingBox *a, BoundingBox *b);
 void updateBoundingBox(RTreeNode *node);
-void insertSensorIntoRTree(RTreeNode *root, SensorNode *sensor);
-void splitNode(RTreeNode *node);
-void rangeQuery(RTreeNode *node, BoundingBox *query_box, void (*callback)(SensorNode *), int *count);
+void initSensorAggregate(SensorAggregate *aggregate);
+void addSensorToAggregate(SensorAggregate *aggregate, SensorNode *sensor);
+void mergeAggregate(SensorAggregate *into, SensorAggregate *from);
+void updateAggregate(RTreeNode *node);
+int regionAggregate(RTreeNode *root, BoundingBox *query_box, SensorAggregate *result);
+void updateSensorReadings(RTree *tree, SensorNode *sensor, SensorNode *record);
+BoundingBox getEntryBox(RTreeNode *node, int i);
+void setEntryBox(RTreeNode *node, int i, BoundingBox *bbox);
+uint64_t overlapMask(RTreeNode *node, BoundingBox *query_box);
+void setSensorEntry(RTreeNode *node, int i, SensorNode *sensor);
+void setChildEntry(RTreeNode *node, int i, RTreeNode *child);
+void moveEntry(RTreeNode *node, int dst, int src);
+void insertSensorIntoRTree(RTree *tree, SensorNode *sensor);
+int insertOrUpdateSensor(RTree *tree, SensorNode *record);
+void splitNode(RTree *tree, RTreeNode *node, int level);
+void reinsertEntries(RTree *tree, RTreeNode *node, int level);
+void handleOverflow(RTree *tree, RTreeNode *node, int level);
+void adjustTree(RTreeNode *node);
+int validateRTree(RTree *tree);
+area_t boxArea(BoundingBox *bbox);
+area_t boxMargin(BoundingBox *bbox);
+area_t overlapArea(BoundingBox *a, BoundingBox *b);
+int chooseSubtree(RTree *tree, RTreeNode *node, BoundingBox *bbox);
+void initSensorFilter(SensorFilter *filter);
+int sensorMatchesFilter(SensorNode *sensor, SensorFilter *filter);
+int aggregateMayMatchFilter(SensorAggregate *aggregate, SensorFilter *filter);
+void openFilteredRangeCursor(QueryCursor *cursor, RTreeNode *root, BoundingBox *query_box, SensorFilter *filter);
+int hottestSensors(RTreeNode *root, BoundingBox *query_box, int k, SensorFilter *filter, SensorNode **results);
+area_t minDistSqToBox(BoundingBox *bbox, coord_t x, coord_t y);
+void openRangeCursor(QueryCursor *cursor, RTreeNode *root, BoundingBox *query_box);
+void openRadiusCursor(QueryCursor *cursor, RTreeNode *root, coord_t center_x, coord_t center_y, coord_t radius,
+                      SensorFilter *filter);
+int fetchRangeResults(QueryCursor *cursor, SensorNode **results, int capacity);
 void printSensor(SensorNode *sensor);
-void deleteSensorFromRTree(RTreeNode *node, SensorNode *sensor);
+void heapPush(MinHeap *heap, area_t key, void *item, int is_sensor);
+HeapItem heapPop(MinHeap *heap);
+void freeHeap(MinHeap *heap);
+int nearestNeighbors(RTreeNode *root, coord_t x, coord_t y, int k, coord_t max_distance, SensorFilter *filter,
+                     NeighborResult *results);
+int printQueryResults(QueryCursor *cursor);
+int printRangeQuery(RTreeNode *root, BoundingBox *query_box);
+int multiRangeQuery(RTreeNode *root, BoundingBox *queries, int num_queries, MultiQueryResult *result);
+void freeMultiQueryResult(MultiQueryResult *result);
+int groupMultiQueryHits(MultiQueryScratch *scratch, MultiQueryResult *result);
+int spatialJoinZones(RTreeNode *root, BoundingBox *zones, int num_zones, MultiQueryResult *result);
+int spatialJoinTrees(RTreeNode *left, RTreeNode *right, coord_t distance, SensorPairs *result);
+void freeSensorPairs(SensorPairs *pairs);
+BoundingBox *loadZoneFile(const char *path, int *count);
+void initRaster(Raster *raster, BoundingBox *extent, int columns, int rows);
+void freeRaster(Raster *raster);
+void rasterizeTree(Raster *raster, RTreeNode *root);
+int writeRasterFrame(Raster *raster, RasterMode mode, const char *path);
+int writeHeatmap(RTreeNode *root, BoundingBox *extent, RasterMode mode, const char *path);
+int treeHeight(RTreeNode *root);
+void collectTreeStats(RTree *tree, TreeStats *stats);
+void printTreeStats(RTree *tree, FILE *out);
+double monotonicSeconds(void);
+#ifdef RTREE_STATS
+void recordQueryTime(double seconds);
+void getRTreeCounters(RTreeCounters *counters);
+void resetRTreeCounters(void);
+#endif
+ConcurrentRTree *createConcurrentRTree(SensorNode *records, int count);
+ConcurrentRTree *wrapConcurrentRTree(RTree *first, RTree *second);
+void destroyConcurrentRTree(ConcurrentRTree *ctree);
+RTree *beginConcurrentRead(ConcurrentRTree *ctree, ReadTicket *ticket);
+void endConcurrentRead(ConcurrentRTree *ctree, ReadTicket *ticket);
+void applyConcurrentWrite(ConcurrentRTree *ctree, TreeWriteOp op, void *arg);
+int concurrentRangeQuery(ConcurrentRTree *ctree, BoundingBox *query_box, SensorNode *results, int capacity);
+int concurrentSearchSensor(ConcurrentRTree *ctree, coord_t x, coord_t y, SensorNode *result);
+int concurrentRegionAggregate(ConcurrentRTree *ctree, BoundingBox *query_box, SensorAggregate *result);
+void concurrentInsertSensor(ConcurrentRTree *ctree, SensorNode *record);
+void concurrentDeleteSensor(ConcurrentRTree *ctree, coord_t x, coord_t y);
+void concurrentUpdateSensor(ConcurrentRTree *ctree, SensorNode *record);
+int deleteSensorFromRTree(RTree *tree, SensorNode *sensor);
+int deleteSensorsInRegion(RTree *tree, BoundingBox *region);
+int deleteSensorList(RTree *tree, SensorNode *records, int count);
+void bulkLoadRTree(RTree *tree, SensorNode **sensors, int count);
+RTreeNode *packLevels(RTree *tree, void **entries, int count, PackKind kind);
 
 // Create a bounding box for a sensor point
 BoundingBox createBoundingBoxForSensor(SensorNode *sensor) {
@@ -65,7 +840,7 @@ BoundingBox createBoundingBoxForSensor(SensorNode *sensor) {
 }
 
 // Create a bounding box with specified coordinates
-BoundingBox *createBoundingBox(int min_x, int min_y, int max_x, int max_y) {
+BoundingBox *createBoundingBox(coord_t min_x, coord_t min_y, coord_t max_x, coord_t max_y) {
     BoundingBox *bbox = (BoundingBox *)malloc(sizeof(BoundingBox));
     bbox->min_x = min_x;
     bbox->min_y = min_y;
@@ -75,435 +850,4570 @@ BoundingBox *createBoundingBox(int min_x, int min_y, int max_x, int max_y) {
 }
 
 
-// Create a new R-tree node (leaf or internal)
-RTreeNode *createRTreeNode(int is_leaf) {
-    RTreeNode *node = (RTreeNode *)malloc(sizeof(RTreeNode));
-    if (!node) {
-        fprintf(stderr, "Memory allocation failed for RTreeNode.\n");
+// Round a size up to a multiple of the given alignment
+size_t alignObjectSize(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Initialise an empty pool for objects of the given size and alignment
+void initObjectPool(ObjectPool *pool, size_t object_size, size_t alignment) {
+    if (alignment < _Alignof(max_align_t)) {
+        alignment = _Alignof(max_align_t);
+    }
+    pool->alignment = alignment;
+    pool->object_size = alignObjectSize(object_size < sizeof(void *) ? sizeof(void *) : object_size, alignment);
+    pool->slab_header = alignObjectSize(sizeof(PoolSlab), alignment);
+    pool->objects_per_slab = (int)((POOL_SLAB_BYTES - pool->slab_header) / pool->object_size);
+    if (pool->objects_per_slab < 1) {
+        pool->objects_per_slab = 1;
+    }
+    pool->slabs = NULL;
+    pool->cursor = NULL;
+    pool->remaining = 0;
+    pool->free_list = NULL;
+}
+
+// Hand out one object, reusing released objects before carving a new slab
+void *poolAlloc(ObjectPool *pool) {
+    if (pool->free_list) {
+        void *object = pool->free_list;
+        pool->free_list = *(void **)object;
+        STAT_ADD(pool_allocs, 1);
+        return object;
+    }
+
+    if (pool->remaining == 0) {
+        size_t slab_bytes = alignObjectSize(pool->slab_header + (size_t)pool->objects_per_slab * pool->object_size, pool->alignment);
+        PoolSlab *slab = (PoolSlab *)aligned_alloc(pool->alignment, slab_bytes);
+        if (!slab) {
+            fprintf(stderr, "Memory allocation failed for pool slab.\n");
+            exit(EXIT_FAILURE);
+        }
+        STAT_ADD(slab_allocs, 1);
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        pool->cursor = (unsigned char *)slab + pool->slab_header;
+        pool->remaining = pool->objects_per_slab;
+    }
+
+    void *object = pool->cursor;
+    pool->cursor += pool->object_size;
+    pool->remaining--;
+    STAT_ADD(pool_allocs, 1);
+    return object;
+}
+
+// Return an object to the pool's free list
+void poolRelease(ObjectPool *pool, void *object) {
+    STAT_ADD(pool_releases, 1);
+    *(void **)object = pool->free_list;
+    pool->free_list = object;
+}
+
+// Free every slab at once; all objects handed out by the pool become invalid
+void destroyObjectPool(ObjectPool *pool) {
+    PoolSlab *slab = pool->slabs;
+    while (slab) {
+        PoolSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    initObjectPool(pool, pool->object_size, pool->alignment);
+}
+
+// 64-bit hash key of a coordinate pair. 32-bit coordinates are packed side by side; wider
+// ones are mixed from their bit patterns (with -0.0 and 0.0 sharing a key).
+uint64_t coordinateKey(coord_t x, coord_t y) {
+#if COORD_TYPE == COORD_INT32
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+#else
+    coord_t values[2] = {x + (coord_t)0, y + (coord_t)0};
+    uint64_t bits[2] = {0, 0};
+    memcpy(&bits[0], &values[0], sizeof(coord_t));
+    memcpy(&bits[1], &values[1], sizeof(coord_t));
+    // SplitMix64 finaliser: float bit patterns keep their entropy in the high bits
+    uint64_t key = bits[0] ^ (bits[1] * 0x9E3779B97F4A7C15ULL + (bits[1] >> 29));
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+#endif
+}
+
+// Home slot of a coordinate pair (Fibonacci hashing of the coordinate key)
+size_t sensorIndexSlot(SensorIndex *index, coord_t x, coord_t y) {
+    uint64_t key = coordinateKey(x, y);
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (index->capacity - 1);
+}
+
+// Initialise an empty index
+void initSensorIndex(SensorIndex *index) {
+    index->capacity = 1024;
+    index->count = 0;
+    index->owns_slots = 1;
+    index->slots = (SensorNode **)calloc(index->capacity, sizeof(SensorNode *));
+    if (!index->slots) {
+        fprintf(stderr, "Memory allocation failed for sensor index.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Release the index's slot array
+void destroySensorIndex(SensorIndex *index) {
+    if (index->owns_slots) {
+        free(index->slots);
+    }
+    index->slots = NULL;
+    index->capacity = index->count = 0;
+}
+
+// Double the slot array and rehash every sensor
+void growSensorIndex(SensorIndex *index) {
+    SensorNode **old_slots = index->slots;
+    size_t old_capacity = index->capacity;
+
+    index->capacity *= 2;
+    index->count = 0;
+    index->slots = (SensorNode **)calloc(index->capacity, sizeof(SensorNode *));
+    if (!index->slots) {
+        fprintf(stderr, "Memory allocation failed for sensor index.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old_slots[i]) {
+            sensorIndexInsert(index, old_slots[i]);
+        }
+    }
+    if (index->owns_slots) {
+        free(old_slots);
+    }
+    index->owns_slots = 1;
+}
+
+// Add a sensor to the index, keeping the load factor at or below one half
+void sensorIndexInsert(SensorIndex *index, SensorNode *sensor) {
+    if ((index->count + 1) * 2 > index->capacity) {
+        growSensorIndex(index);
+    }
+    size_t mask = index->capacity - 1;
+    size_t i = sensorIndexSlot(index, sensor->x, sensor->y);
+    while (index->slots[i]) {
+        i = (i + 1) & mask;
+    }
+    index->slots[i] = sensor;
+    index->count++;
+}
+
+// Remove a specific sensor from the index; later entries of its probe run are shifted back
+void sensorIndexRemove(SensorIndex *index, SensorNode *sensor) {
+    size_t mask = index->capacity - 1;
+    size_t i = sensorIndexSlot(index, sensor->x, sensor->y);
+    while (index->slots[i] && index->slots[i] != sensor) {
+        i = (i + 1) & mask;
+    }
+    if (!index->slots[i]) {
+        return;
+    }
+
+    index->slots[i] = NULL;
+    index->count--;
+    for (size_t j = (i + 1) & mask; index->slots[j]; j = (j + 1) & mask) {
+        size_t home = sensorIndexSlot(index, index->slots[j]->x, index->slots[j]->y);
+        // Move the entry into the hole unless its home lies cyclically in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            index->slots[i] = index->slots[j];
+            index->slots[j] = NULL;
+            i = j;
+        }
+    }
+}
+
+// Find a sensor by its coordinates, or NULL if none is indexed there
+SensorNode *sensorIndexFind(SensorIndex *index, coord_t x, coord_t y) {
+    size_t mask = index->capacity - 1;
+    for (size_t i = sensorIndexSlot(index, x, y); index->slots[i]; i = (i + 1) & mask) {
+        if (index->slots[i]->x == x && index->slots[i]->y == y) {
+            return index->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// Create an empty tree whose root is a leaf
+RTree *createRTree(SplitPolicy policy) {
+    RTree *tree = (RTree *)malloc(sizeof(RTree));
+    if (!tree) {
+        fprintf(stderr, "Memory allocation failed for RTree.\n");
         exit(EXIT_FAILURE);
     }
+    initObjectPool(&tree->node_pool, sizeof(RTreeNode), _Alignof(RTreeNode));
+    initObjectPool(&tree->sensor_pool, sizeof(SensorNode), _Alignof(SensorNode));
+    initSensorIndex(&tree->index);
+    tree->policy = policy;
+    tree->reinserted_levels = 0;
+    tree->mapping = NULL;
+    tree->history = NULL;
+    tree->standing = NULL;
+    tree->mapping_size = 0;
+    tree->root = createRTreeNode(tree, 1);
+    updateBoundingBox(tree->root);
+    return tree;
+}
+
+// Tear down the whole tree: nodes and sensors go with their slabs
+void destroyRTree(RTree *tree) {
+    destroySensorIndex(&tree->index);
+    destroyObjectPool(&tree->node_pool);
+    destroyObjectPool(&tree->sensor_pool);
+    if (tree->mapping) {
+        munmap(tree->mapping, tree->mapping_size);
+    }
+    destroySensorHistory(tree->history);
+    destroyStandingQueries(tree->standing);
+    free(tree);
+}
+
+// Command-line name of a split policy
+const char *splitPolicyName(SplitPolicy policy) {
+    switch (policy) {
+    case SPLIT_LINEAR:
+        return "linear";
+    case SPLIT_QUADRATIC:
+        return "quadratic";
+    default:
+        return "rstar";
+    }
+}
+
+// Parse a split policy name; returns 0 if it is not recognised
+int parseSplitPolicy(const char *name, SplitPolicy *policy) {
+    if (strcmp(name, "linear") == 0) {
+        *policy = SPLIT_LINEAR;
+    } else if (strcmp(name, "quadratic") == 0) {
+        *policy = SPLIT_QUADRATIC;
+    } else if (strcmp(name, "rstar") == 0) {
+        *policy = SPLIT_RSTAR;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// O(1) lookup of the sensor at (x, y) through the tree's coordinate index
+SensorNode *findSensorAt(RTree *tree, coord_t x, coord_t y) {
+    return sensorIndexFind(&tree->index, x, y);
+}
+
+// Allocate a sensor owned by the tree's sensor pool
+SensorNode *createSensorNode(RTree *tree) {
+    return (SensorNode *)poolAlloc(&tree->sensor_pool);
+}
 
+// Create a new R-tree node (leaf or internal)
+RTreeNode *createRTreeNode(RTree *tree, int is_leaf) {
+    RTreeNode *node = (RTreeNode *)poolAlloc(&tree->node_pool);
     node->is_leaf = is_leaf;
     node->num_entries = 0;
     node->parent = NULL;
+    return node;
+}
 
-    // Allocate memory for children or sensors based on node type
-    if (is_leaf) {
-        node->children = NULL;  // No children for leaf nodes
-        node->sensors = (SensorNode **)malloc(MAX_ENTRIES * sizeof(SensorNode *));
-        if (!node->sensors) {
-            fprintf(stderr, "Memory allocation failed for sensors in leaf node.\n");
-            free(node);
-            exit(EXIT_FAILURE);
-        }
+// Check if two bounding boxes overlap
+int overlaps(BoundingBox *a, BoundingBox *b) {
+    return !(a->min_x > b->max_x || a->max_x < b->min_x || a->min_y > b->max_y || a->max_y < b->min_y);
+}
+
+// Expand bounding box 'a' to include bounding box 'b'
+void expandToInclude(BoundingBox *a, BoundingBox *b) {
+    a->min_x = a->min_x < b->min_x ? a->min_x : b->min_x;
+    a->min_y = a->min_y < b->min_y ? a->min_y : b->min_y;
+    a->max_x = a->max_x > b->max_x ? a->max_x : b->max_x;
+    a->max_y = a->max_y > b->max_y ? a->max_y : b->max_y;
+}
+
+// Read the bounding box of entry i out of the node's coordinate arrays
+BoundingBox getEntryBox(RTreeNode *node, int i) {
+    BoundingBox bbox = {node->entry_min_x[i], node->entry_min_y[i], node->entry_max_x[i], node->entry_max_y[i]};
+    return bbox;
+}
+
+// Write the bounding box of entry i into the node's coordinate arrays
+void setEntryBox(RTreeNode *node, int i, BoundingBox *bbox) {
+    node->entry_min_x[i] = bbox->min_x;
+    node->entry_min_y[i] = bbox->min_y;
+    node->entry_max_x[i] = bbox->max_x;
+    node->entry_max_y[i] = bbox->max_y;
+}
+
+// Test the query box against every entry of a node; bit i of the result is set when entry i overlaps
+uint64_t overlapMask(RTreeNode *node, BoundingBox *query_box) {
+    uint64_t mask = 0;
+    int i = 0;
+#if defined(RTREE_USE_AVX2) || defined(RTREE_USE_SSE2)
+    coord_vec q_min_x = VEC_SET1(query_box->min_x);
+    coord_vec q_min_y = VEC_SET1(query_box->min_y);
+    coord_vec q_max_x = VEC_SET1(query_box->max_x);
+    coord_vec q_max_y = VEC_SET1(query_box->max_y);
+    for (; i < node->num_entries; i += COORD_LANES) {
+        coord_vec min_x = VEC_LOAD(&node->entry_min_x[i]);
+        coord_vec min_y = VEC_LOAD(&node->entry_min_y[i]);
+        coord_vec max_x = VEC_LOAD(&node->entry_max_x[i]);
+        coord_vec max_y = VEC_LOAD(&node->entry_max_y[i]);
+        coord_vec miss = VEC_OR(VEC_OR(VEC_GT(min_x, q_max_x), VEC_GT(q_min_x, max_x)),
+                                VEC_OR(VEC_GT(min_y, q_max_y), VEC_GT(q_min_y, max_y)));
+        uint64_t hits = (uint64_t)(~VEC_MOVEMASK(miss) & ((1 << COORD_LANES) - 1));
+        mask |= hits << i;
+    }
+#else
+    for (; i < node->num_entries; i++) {
+        int miss = node->entry_min_x[i] > query_box->max_x || query_box->min_x > node->entry_max_x[i] ||
+                   node->entry_min_y[i] > query_box->max_y || query_box->min_y > node->entry_max_y[i];
+        mask |= (uint64_t)!miss << i;
+    }
+#endif
+    // The vector loops read whole registers; drop the lanes past the last entry
+    if (node->num_entries < 64) {
+        mask &= ((uint64_t)1 << node->num_entries) - 1;
+    }
+    return mask;
+}
+
+// Update the bounding box of a node to cover all its children/sensors, and its aggregate with it
+void updateBoundingBox(RTreeNode *node) {
+    if (node->num_entries == 0) {
+        node->bbox = (BoundingBox){COORD_MAX, COORD_MAX, COORD_MIN, COORD_MIN};
     } else {
-        node->sensors = NULL;  // No sensors for internal nodes
-        node->children = (RTreeNode **)malloc(MAX_ENTRIES * sizeof(RTreeNode *));
-        if (!node->children) {
-            fprintf(stderr, "Memory allocation failed for children in internal node.\n");
-            free(node);
-            exit(EXIT_FAILURE);
+        node->bbox = getEntryBox(node, 0);
+        for (int i = 1; i < node->num_entries; i++) {
+            BoundingBox entry_bbox = getEntryBox(node, i);
+            expandToInclude(&node->bbox, &entry_bbox);
         }
     }
-    return node;
+
+    updateAggregate(node);
+
+    // Keep the parent's copy of this node's bounding box in sync
+    RTreeNode *parent = node->parent;
+    if (parent) {
+        for (int i = 0; i < parent->num_entries; i++) {
+            if (parent->children[i] == node) {
+                setEntryBox(parent, i, &node->bbox);
+                break;
+            }
+        }
+    }
+}
+
+// Start an empty aggregate
+void initSensorAggregate(SensorAggregate *aggregate) {
+    aggregate->count = 0;
+    aggregate->sum_humidity = aggregate->sum_pollution = aggregate->sum_temperature = 0;
+    aggregate->min_humidity = aggregate->min_pollution = aggregate->min_temperature = INT_MAX;
+    aggregate->max_humidity = aggregate->max_pollution = aggregate->max_temperature = INT_MIN;
+}
+
+// Fold one sensor's readings into an aggregate
+void addSensorToAggregate(SensorAggregate *aggregate, SensorNode *sensor) {
+    aggregate->count++;
+    aggregate->sum_humidity += sensor->humidity;
+    aggregate->sum_pollution += sensor->PollutionLevel;
+    aggregate->sum_temperature += sensor->temperature;
+    aggregate->min_humidity = sensor->humidity < aggregate->min_humidity ? sensor->humidity : aggregate->min_humidity;
+    aggregate->max_humidity = sensor->humidity > aggregate->max_humidity ? sensor->humidity : aggregate->max_humidity;
+    aggregate->min_pollution = sensor->PollutionLevel < aggregate->min_pollution ? sensor->PollutionLevel : aggregate->min_pollution;
+    aggregate->max_pollution = sensor->PollutionLevel > aggregate->max_pollution ? sensor->PollutionLevel : aggregate->max_pollution;
+    aggregate->min_temperature = sensor->temperature < aggregate->min_temperature ? sensor->temperature : aggregate->min_temperature;
+    aggregate->max_temperature = sensor->temperature > aggregate->max_temperature ? sensor->temperature : aggregate->max_temperature;
+}
+
+// Fold one aggregate into another
+void mergeAggregate(SensorAggregate *into, SensorAggregate *from) {
+    into->count += from->count;
+    into->sum_humidity += from->sum_humidity;
+    into->sum_pollution += from->sum_pollution;
+    into->sum_temperature += from->sum_temperature;
+    into->min_humidity = from->min_humidity < into->min_humidity ? from->min_humidity : into->min_humidity;
+    into->max_humidity = from->max_humidity > into->max_humidity ? from->max_humidity : into->max_humidity;
+    into->min_pollution = from->min_pollution < into->min_pollution ? from->min_pollution : into->min_pollution;
+    into->max_pollution = from->max_pollution > into->max_pollution ? from->max_pollution : into->max_pollution;
+    into->min_temperature = from->min_temperature < into->min_temperature ? from->min_temperature : into->min_temperature;
+    into->max_temperature = from->max_temperature > into->max_temperature ? from->max_temperature : into->max_temperature;
+}
+
+// Recompute a node's aggregate from its sensors or from its children's aggregates
+void updateAggregate(RTreeNode *node) {
+    initSensorAggregate(&node->aggregate);
+    for (int i = 0; i < node->num_entries; i++) {
+        if (node->is_leaf) {
+            addSensorToAggregate(&node->aggregate, node->sensors[i]);
+        } else {
+            mergeAggregate(&node->aggregate, &node->children[i]->aggregate);
+        }
+    }
+}
+
+// Store a sensor in slot i of a leaf together with its bounding box
+void setSensorEntry(RTreeNode *node, int i, SensorNode *sensor) {
+    BoundingBox sensor_bbox = createBoundingBoxForSensor(sensor);
+    node->sensors[i] = sensor;
+    sensor->leaf = node;
+    setEntryBox(node, i, &sensor_bbox);
+}
+
+// Store a child in slot i of an internal node together with its bounding box
+void setChildEntry(RTreeNode *node, int i, RTreeNode *child) {
+    node->children[i] = child;
+    setEntryBox(node, i, &child->bbox);
+}
+
+// Copy entry src over entry dst within the same node
+void moveEntry(RTreeNode *node, int dst, int src) {
+    node->children[dst] = node->children[src];
+    node->entry_min_x[dst] = node->entry_min_x[src];
+    node->entry_min_y[dst] = node->entry_min_y[src];
+    node->entry_max_x[dst] = node->entry_max_x[src];
+    node->entry_max_y[dst] = node->entry_max_y[src];
+}
+
+// Area, margin (half perimeter) and overlap of boxes, computed in area_t so they cannot overflow
+area_t boxArea(BoundingBox *bbox) {
+    return ((area_t)bbox->max_x - bbox->min_x) * ((area_t)bbox->max_y - bbox->min_y);
+}
+
+area_t boxMargin(BoundingBox *bbox) {
+    return ((area_t)bbox->max_x - bbox->min_x) + ((area_t)bbox->max_y - bbox->min_y);
+}
+
+area_t overlapArea(BoundingBox *a, BoundingBox *b) {
+    area_t w = (area_t)(a->max_x < b->max_x ? a->max_x : b->max_x) - (a->min_x > b->min_x ? a->min_x : b->min_x);
+    area_t h = (area_t)(a->max_y < b->max_y ? a->max_y : b->max_y) - (a->min_y > b->min_y ? a->min_y : b->min_y);
+    return w > 0 && h > 0 ? w * h : 0;
+}
+
+// Area by which bbox would grow if it had to include extra
+area_t enlargementOf(BoundingBox *bbox, BoundingBox *extra) {
+    BoundingBox expanded = *bbox;
+    expandToInclude(&expanded, extra);
+    return boxArea(&expanded) - boxArea(bbox);
+}
+
+// Increase in overlap with the other entries if entry k of node grew to include bbox (R*)
+area_t overlapEnlargement(RTreeNode *node, int k, BoundingBox *bbox) {
+    BoundingBox before = getEntryBox(node, k);
+    BoundingBox after = before;
+    expandToInclude(&after, bbox);
+
+    area_t delta = 0;
+    for (int j = 0; j < node->num_entries; j++) {
+        if (j != k) {
+            BoundingBox other = getEntryBox(node, j);
+            delta += overlapArea(&after, &other) - overlapArea(&before, &other);
+        }
+    }
+    return delta;
+}
+
+// Pick the child of an internal node that should receive bbox. Children that already
+// contain it win outright (smallest area first); otherwise Guttman takes the least area
+// enlargement and R* takes the least overlap enlargement just above the leaves.
+int chooseSubtree(RTree *tree, RTreeNode *node, BoundingBox *bbox) {
+    int best = -1;
+    area_t best_area = AREA_MAX;
+    for (uint64_t candidates = overlapMask(node, bbox); candidates; candidates &= candidates - 1) {
+        int i = __builtin_ctzll(candidates);
+        BoundingBox entry_bbox = getEntryBox(node, i);
+        if (entry_bbox.min_x <= bbox->min_x && entry_bbox.min_y <= bbox->min_y &&
+            entry_bbox.max_x >= bbox->max_x && entry_bbox.max_y >= bbox->max_y && boxArea(&entry_bbox) < best_area) {
+            best = i;
+            best_area = boxArea(&entry_bbox);
+        }
+    }
+    if (best >= 0) {
+        return best;
+    }
+
+    int use_overlap = tree->policy == SPLIT_RSTAR && node->children[0]->is_leaf;
+    area_t best_overlap = AREA_MAX, best_enlargement = AREA_MAX;
+    for (int i = 0; i < node->num_entries; i++) {
+        BoundingBox entry_bbox = getEntryBox(node, i);
+        area_t overlap = use_overlap ? overlapEnlargement(node, i, bbox) : 0;
+        area_t enlargement = enlargementOf(&entry_bbox, bbox);
+        area_t entry_area = boxArea(&entry_bbox);
+        if (overlap < best_overlap ||
+            (overlap == best_overlap && (enlargement < best_enlargement ||
+                                         (enlargement == best_enlargement && entry_area < best_area)))) {
+            best = i;
+            best_overlap = overlap;
+            best_enlargement = enlargement;
+            best_area = entry_area;
+        }
+    }
+    return best;
+}
+
+// Store an entry (sensor or child) in slot i of a node, adopting the child if there is one
+void setNodeEntry(RTreeNode *node, int i, void *item, BoundingBox *bbox) {
+    node->children[i] = (RTreeNode *)item;
+    setEntryBox(node, i, bbox);
+    if (node->is_leaf) {
+        ((SensorNode *)item)->leaf = node;
+    } else {
+        ((RTreeNode *)item)->parent = node;
+    }
+}
+
+// Refit the bounding boxes from node up to the root (Guttman's AdjustTree)
+void adjustTree(RTreeNode *node) {
+    for (; node; node = node->parent) {
+        updateBoundingBox(node);
+    }
+}
+
+// Place an entry in a node at the given level (0 = leaves) and resolve any overflow
+void insertEntryAtLevel(RTree *tree, void *item, BoundingBox *bbox, int level) {
+    // Descend to the requested level, choosing a subtree at each step
+    RTreeNode *node = tree->root;
+    for (int node_level = treeHeight(node) - 1; node_level > level; node_level--) {
+        node = node->children[chooseSubtree(tree, node, bbox)];
+    }
+
+    setNodeEntry(node, node->num_entries, item, bbox);
+    node->num_entries++;
+    if (node->num_entries > MAX_ENTRIES) {
+        handleOverflow(tree, node, level);
+    } else {
+        adjustTree(node);
+    }
+}
+
+// Resolve an overflowing node: R* reinserts part of it the first time a level overflows
+// during an insertion, everything else splits (which may overflow the parent in turn)
+void handleOverflow(RTree *tree, RTreeNode *node, int level) {
+    unsigned int level_bit = 1u << level;
+    if (tree->policy == SPLIT_RSTAR && node->parent && !(tree->reinserted_levels & level_bit)) {
+        tree->reinserted_levels |= level_bit;
+        reinsertEntries(tree, node, level);
+    } else {
+        splitNode(tree, node, level);
+    }
+}
+
+// Insert a sensor into the R-tree and handle splitting if necessary.
+// No other sensor may be at its coordinates; insertOrUpdateSensor checks that first.
+void insertSensorIntoRTree(RTree *tree, SensorNode *sensor) {
+    if (!sensor) {
+        fprintf(stderr, "Error: Attempting to insert a NULL sensor.\n");
+        return;
+    }
+    sensorIndexInsert(&tree->index, sensor);
+
+    BoundingBox sensor_bbox = createBoundingBoxForSensor(sensor);
+    tree->reinserted_levels = 0;
+    insertEntryAtLevel(tree, sensor, &sensor_bbox, 0);
+    if (tree->standing) {
+        notifyStandingQueries(tree->standing, sensor, SENSOR_ADDED, 0);
+    }
+}
+
+// Insert a copy of record, or, if a sensor is already at its coordinates, overwrite that
+// sensor's readings instead: there is at most one sensor per point. Returns 1 if a sensor was added.
+int insertOrUpdateSensor(RTree *tree, SensorNode *record) {
+    SensorNode *existing_sensor = findSensorAt(tree, record->x, record->y);
+    if (existing_sensor) {
+        updateSensorReadings(tree, existing_sensor, record);
+        return 0;
+    }
+    SensorNode *sensor = createSensorNode(tree);
+    *sensor = *record;
+    insertSensorIntoRTree(tree, sensor);
+    return 1;
+}
+
+// R* forced reinsertion: take the entries farthest from the centre of an overflowing node
+// out of it and insert them again at the same level, nearest first, which often avoids a split
+void reinsertEntries(RTree *tree, RTreeNode *node, int level) {
+    STAT_ADD(reinserts, 1);
+    int n = node->num_entries;
+    int p = n * RSTAR_REINSERT_PERCENT / 100;
+    if (p < 1) {
+        p = 1;
+    }
+
+    // Order entries by the distance of their centre from the node's centre (coordinates doubled)
+    area_t center_x = (area_t)node->bbox.min_x + node->bbox.max_x;
+    area_t center_y = (area_t)node->bbox.min_y + node->bbox.max_y;
+    area_t distance[MAX_ENTRIES + 1];
+    int order[MAX_ENTRIES + 1];
+    for (int i = 0; i < n; i++) {
+        area_t dx = (area_t)node->entry_min_x[i] + node->entry_max_x[i] - center_x;
+        area_t dy = (area_t)node->entry_min_y[i] + node->entry_max_y[i] - center_y;
+        distance[i] = dx * dx + dy * dy;
+        order[i] = i;
+        for (int j = i; j > 0 && distance[order[j - 1]] < distance[order[j]]; j--) {
+            int swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+    }
+
+    // Keep the n - p closest entries and refit the path to the root before reinserting
+    SplitEntry removed[MAX_ENTRIES + 1];
+    int keep[MAX_ENTRIES + 1] = {0};
+    for (int k = 0; k < p; k++) {
+        removed[k].bbox = getEntryBox(node, order[k]);
+        removed[k].item = node->children[order[k]];
+    }
+    for (int k = p; k < n; k++) {
+        keep[order[k]] = 1;
+    }
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        if (keep[i]) {
+            moveEntry(node, kept++, i);
+        }
+    }
+    node->num_entries = kept;
+    adjustTree(node);
+
+    for (int k = p - 1; k >= 0; k--) {
+        insertEntryAtLevel(tree, removed[k].item, &removed[k].bbox, level);
+    }
+}
+
+// Sort entry indices by one side of their boxes along an axis (insertion sort; n <= MAX_ENTRIES + 1)
+void sortSplitEntries(SplitEntry *entries, int n, int axis, int by_upper, int *order) {
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    for (int i = 1; i < n; i++) {
+        int current = order[i];
+        BoundingBox *b = &entries[current].bbox;
+        coord_t key = axis == 0 ? (by_upper ? b->max_x : b->min_x) : (by_upper ? b->max_y : b->min_y);
+        int j = i;
+        while (j > 0) {
+            BoundingBox *a = &entries[order[j - 1]].bbox;
+            coord_t other = axis == 0 ? (by_upper ? a->max_x : a->min_x) : (by_upper ? a->max_y : a->min_y);
+            if (other <= key) {
+                break;
+            }
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = current;
+    }
+}
+
+// Guttman's distribution step after the two seeds are placed. Each remaining entry goes to the
+// group needing the least enlargement (ties: smaller area, then fewer entries) unless a group
+// needs every remaining entry to reach MIN_ENTRIES. Quadratic picks the entry with the strongest
+// preference next; linear takes them in order.
+void distributeGuttman(SplitEntry *entries, int n, int seed1, int seed2, int quadratic, int *group) {
+    BoundingBox group_bbox[2] = {entries[seed1].bbox, entries[seed2].bbox};
+    int group_count[2] = {1, 1};
+    int assigned[MAX_ENTRIES + 1] = {0};
+    group[seed1] = 0;
+    group[seed2] = 1;
+    assigned[seed1] = assigned[seed2] = 1;
+
+    for (int remaining = n - 2; remaining > 0; remaining--) {
+        int forced = -1;
+        if (group_count[0] + remaining <= MIN_ENTRIES) {
+            forced = 0;
+        } else if (group_count[1] + remaining <= MIN_ENTRIES) {
+            forced = 1;
+        }
+
+        int next = -1;
+        area_t best_preference = -1;
+        for (int i = 0; i < n; i++) {
+            if (assigned[i]) {
+                continue;
+            }
+            if (!quadratic || forced >= 0) {
+                next = i;
+                break;
+            }
+            area_t d0 = enlargementOf(&group_bbox[0], &entries[i].bbox);
+            area_t d1 = enlargementOf(&group_bbox[1], &entries[i].bbox);
+            area_t preference = d0 > d1 ? d0 - d1 : d1 - d0;
+            if (preference > best_preference) {
+                best_preference = preference;
+                next = i;
+            }
+        }
+
+        int target = forced;
+        if (target < 0) {
+            area_t d0 = enlargementOf(&group_bbox[0], &entries[next].bbox);
+            area_t d1 = enlargementOf(&group_bbox[1], &entries[next].bbox);
+            if (d0 != d1) {
+                target = d0 < d1 ? 0 : 1;
+            } else if (boxArea(&group_bbox[0]) != boxArea(&group_bbox[1])) {
+                target = boxArea(&group_bbox[0]) < boxArea(&group_bbox[1]) ? 0 : 1;
+            } else {
+                target = group_count[0] <= group_count[1] ? 0 : 1;
+            }
+        }
+
+        group[next] = target;
+        assigned[next] = 1;
+        group_count[target]++;
+        expandToInclude(&group_bbox[target], &entries[next].bbox);
+    }
+}
+
+// Guttman's linear split: seeds are the pair with the greatest normalised separation along either axis
+void splitLinear(SplitEntry *entries, int n, int *group) {
+    int seed1 = 0, seed2 = 1;
+    double best_separation = -1.0;
+    for (int axis = 0; axis < 2; axis++) {
+        int highest_low = 0, lowest_high = 0;
+        coord_t lowest = COORD_MAX, highest = COORD_MIN;
+        for (int i = 0; i < n; i++) {
+            BoundingBox *b = &entries[i].bbox;
+            coord_t low = axis == 0 ? b->min_x : b->min_y;
+            coord_t high = axis == 0 ? b->max_x : b->max_y;
+            BoundingBox *hl = &entries[highest_low].bbox, *lh = &entries[lowest_high].bbox;
+            if (low > (axis == 0 ? hl->min_x : hl->min_y)) {
+                highest_low = i;
+            }
+            if (high < (axis == 0 ? lh->max_x : lh->max_y)) {
+                lowest_high = i;
+            }
+            lowest = low < lowest ? low : lowest;
+            highest = high > highest ? high : highest;
+        }
+        if (highest_low == lowest_high) {
+            lowest_high = highest_low == 0 ? 1 : 0;
+        }
+
+        BoundingBox *hl = &entries[highest_low].bbox, *lh = &entries[lowest_high].bbox;
+        double width = (double)highest - lowest;
+        double gap = axis == 0 ? (double)hl->min_x - lh->max_x : (double)hl->min_y - lh->max_y;
+        double separation = width > 0 ? gap / width : 0.0;
+        if (separation > best_separation) {
+            best_separation = separation;
+            seed1 = lowest_high;
+            seed2 = highest_low;
+        }
+    }
+    distributeGuttman(entries, n, seed1, seed2, 0, group);
+}
+
+// Guttman's quadratic split: seeds are the pair that would waste the most area together
+void splitQuadratic(SplitEntry *entries, int n, int *group) {
+    int seed1 = 0, seed2 = 1;
+    area_t worst_waste = -AREA_MAX;
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            BoundingBox combined = entries[i].bbox;
+            expandToInclude(&combined, &entries[j].bbox);
+            area_t waste = boxArea(&combined) - boxArea(&entries[i].bbox) - boxArea(&entries[j].bbox);
+            if (waste > worst_waste) {
+                worst_waste = waste;
+                seed1 = i;
+                seed2 = j;
+            }
+        }
+    }
+    distributeGuttman(entries, n, seed1, seed2, 1, group);
+}
+
+// R* split: choose the axis whose candidate distributions have the smallest total margin,
+// then the distribution along it with the least overlap (ties: least total area)
+void splitRStar(SplitEntry *entries, int n, int *group) {
+    int order[MAX_ENTRIES + 1];
+    BoundingBox prefix[MAX_ENTRIES + 1], suffix[MAX_ENTRIES + 1];
+    int distributions = n - 2 * MIN_ENTRIES + 1;
+
+    int best_axis = 0;
+    area_t best_margin = AREA_MAX;
+    for (int axis = 0; axis < 2; axis++) {
+        area_t margin = 0;
+        for (int by_upper = 0; by_upper < 2; by_upper++) {
+            sortSplitEntries(entries, n, axis, by_upper, order);
+            prefix[0] = entries[order[0]].bbox;
+            for (int i = 1; i < n; i++) {
+                prefix[i] = prefix[i - 1];
+                expandToInclude(&prefix[i], &entries[order[i]].bbox);
+            }
+            suffix[n - 1] = entries[order[n - 1]].bbox;
+            for (int i = n - 2; i >= 0; i--) {
+                suffix[i] = suffix[i + 1];
+                expandToInclude(&suffix[i], &entries[order[i]].bbox);
+            }
+            for (int k = 0; k < distributions; k++) {
+                int split = MIN_ENTRIES + k;  // First group holds order[0 .. split)
+                margin += boxMargin(&prefix[split - 1]) + boxMargin(&suffix[split]);
+            }
+        }
+        if (margin < best_margin) {
+            best_margin = margin;
+            best_axis = axis;
+        }
+    }
+
+    area_t best_overlap = AREA_MAX, best_area = AREA_MAX;
+    int best_order[MAX_ENTRIES + 1];
+    int best_split = MIN_ENTRIES;
+    for (int by_upper = 0; by_upper < 2; by_upper++) {
+        sortSplitEntries(entries, n, best_axis, by_upper, order);
+        prefix[0] = entries[order[0]].bbox;
+        for (int i = 1; i < n; i++) {
+            prefix[i] = prefix[i - 1];
+            expandToInclude(&prefix[i], &entries[order[i]].bbox);
+        }
+        suffix[n - 1] = entries[order[n - 1]].bbox;
+        for (int i = n - 2; i >= 0; i--) {
+            suffix[i] = suffix[i + 1];
+            expandToInclude(&suffix[i], &entries[order[i]].bbox);
+        }
+        for (int k = 0; k < distributions; k++) {
+            int split = MIN_ENTRIES + k;
+            area_t overlap = overlapArea(&prefix[split - 1], &suffix[split]);
+            area_t total_area = boxArea(&prefix[split - 1]) + boxArea(&suffix[split]);
+            if (overlap < best_overlap || (overlap == best_overlap && total_area < best_area)) {
+                best_overlap = overlap;
+                best_area = total_area;
+                best_split = split;
+                memcpy(best_order, order, n * sizeof(int));
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        group[best_order[i]] = i < best_split ? 0 : 1;
+    }
+}
+
+// Split an overflowing node (leaf or internal) at the given level in two using the tree's
+// split policy. The node keeps the first group and a new sibling takes the second; the
+// sibling is added to the parent, which is split in turn if it overflows, and a split
+// root is replaced by a new root one level higher.
+void splitNode(RTree *tree, RTreeNode *node, int level) {
+    STAT_ADD(splits, 1);
+    // Step 1: Take a copy of the entries so the original node can be reused as the first half
+    int num_entries = node->num_entries;
+    SplitEntry entries[MAX_ENTRIES + 1];
+    int group[MAX_ENTRIES + 1];
+    for (int i = 0; i < num_entries; i++) {
+        entries[i].bbox = getEntryBox(node, i);
+        entries[i].item = node->children[i];
+    }
+
+    // Step 2: Partition the entries into two groups
+    switch (tree->policy) {
+    case SPLIT_LINEAR:
+        splitLinear(entries, num_entries, group);
+        break;
+    case SPLIT_QUADRATIC:
+        splitQuadratic(entries, num_entries, group);
+        break;
+    default:
+        splitRStar(entries, num_entries, group);
+        break;
+    }
+
+    // Step 3: Refill the node with the first group and a new sibling with the second
+    RTreeNode *node1 = node;
+    RTreeNode *node2 = createRTreeNode(tree, node->is_leaf);
+    node1->num_entries = 0;
+    for (int i = 0; i < num_entries; i++) {
+        RTreeNode *target = group[i] ? node2 : node1;
+        setNodeEntry(target, target->num_entries++, entries[i].item, &entries[i].bbox);
+    }
+    updateBoundingBox(node1);
+    updateBoundingBox(node2);
+
+    // Step 4: Add the sibling to the parent, or grow the tree by a new root
+    RTreeNode *parent = node1->parent;
+    if (!parent) {
+        RTreeNode *new_root = createRTreeNode(tree, 0);
+        setNodeEntry(new_root, 0, node1, &node1->bbox);
+        setNodeEntry(new_root, 1, node2, &node2->bbox);
+        new_root->num_entries = 2;
+        updateBoundingBox(new_root);
+        tree->root = new_root;
+        return;
+    }
+    setNodeEntry(parent, parent->num_entries, node2, &node2->bbox);
+    parent->num_entries++;
+    if (parent->num_entries > MAX_ENTRIES) {
+        handleOverflow(tree, parent, level + 1);
+    } else {
+        adjustTree(parent);
+    }
+}
+
+// Smallest integer s with s * s >= n (number of STR slices)
+int ceilSqrt(int n) {
+    int s = 0;
+    while (s * s < n) {
+        s++;
+    }
+    return s;
+}
+
+// qsort comparators for Sort-Tile-Recursive packing
+int compareSensorsByX(const void *a, const void *b) {
+    const SensorNode *sa = *(SensorNode *const *)a;
+    const SensorNode *sb = *(SensorNode *const *)b;
+    return (sa->x > sb->x) - (sa->x < sb->x);
+}
+
+int compareSensorsByY(const void *a, const void *b) {
+    const SensorNode *sa = *(SensorNode *const *)a;
+    const SensorNode *sb = *(SensorNode *const *)b;
+    return (sa->y > sb->y) - (sa->y < sb->y);
+}
+
+// Nodes are ordered by the centre of their bounding box (min + max, widened, avoids the division)
+int compareNodesByCenterX(const void *a, const void *b) {
+    const RTreeNode *na = *(RTreeNode *const *)a;
+    const RTreeNode *nb = *(RTreeNode *const *)b;
+    area_t ca = (area_t)na->bbox.min_x + na->bbox.max_x;
+    area_t cb = (area_t)nb->bbox.min_x + nb->bbox.max_x;
+    return (ca > cb) - (ca < cb);
+}
+
+int compareNodesByCenterY(const void *a, const void *b) {
+    const RTreeNode *na = *(RTreeNode *const *)a;
+    const RTreeNode *nb = *(RTreeNode *const *)b;
+    area_t ca = (area_t)na->bbox.min_y + na->bbox.max_y;
+    area_t cb = (area_t)nb->bbox.min_y + nb->bbox.max_y;
+    return (ca > cb) - (ca < cb);
+}
+
+// Zones are ordered the same way
+int compareZonesByCenterX(const void *a, const void *b) {
+    const BoundingBox *za = *(BoundingBox *const *)a;
+    const BoundingBox *zb = *(BoundingBox *const *)b;
+    area_t ca = (area_t)za->min_x + za->max_x;
+    area_t cb = (area_t)zb->min_x + zb->max_x;
+    return (ca > cb) - (ca < cb);
+}
+
+int compareZonesByCenterY(const void *a, const void *b) {
+    const BoundingBox *za = *(BoundingBox *const *)a;
+    const BoundingBox *zb = *(BoundingBox *const *)b;
+    area_t ca = (area_t)za->min_y + za->max_y;
+    area_t cb = (area_t)zb->min_y + zb->max_y;
+    return (ca > cb) - (ca < cb);
+}
+
+// Pack one level of STR: sort by x, cut into vertical slices, sort each slice by y
+// and cut it into nodes of at most MAX_ENTRIES. Slices and nodes are sized evenly so
+// that no node ends up below MIN_ENTRIES. Returns the new level and stores its size in *out_count.
+RTreeNode **packLevel(RTree *tree, void **entries, int count, PackKind kind, int *out_count) {
+    static int (*const by_x[])(const void *, const void *) = {compareSensorsByX, compareZonesByCenterX, compareNodesByCenterX};
+    static int (*const by_y[])(const void *, const void *) = {compareSensorsByY, compareZonesByCenterY, compareNodesByCenterY};
+    int num_nodes = (count + MAX_ENTRIES - 1) / MAX_ENTRIES;
+    int num_slices = ceilSqrt(num_nodes);
+
+    // Even sizing can add at most one node per slice
+    RTreeNode **level = (RTreeNode **)malloc((num_nodes + num_slices) * sizeof(RTreeNode *));
+    if (!level) {
+        fprintf(stderr, "Memory allocation failed for bulk load level.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    qsort(entries, count, sizeof(void *), by_x[kind]);
+
+    int n = 0;
+    for (int slice = 0; slice < num_slices; slice++) {
+        int start = (int)((long long)count * slice / num_slices);
+        int slice_count = (int)((long long)count * (slice + 1) / num_slices) - start;
+        qsort(entries + start, slice_count, sizeof(void *), by_y[kind]);
+
+        int slice_nodes = (slice_count + MAX_ENTRIES - 1) / MAX_ENTRIES;
+        for (int k = 0; k < slice_nodes; k++) {
+            int first = start + slice_count * k / slice_nodes;
+            int fill = start + slice_count * (k + 1) / slice_nodes - first;
+            RTreeNode *node = createRTreeNode(tree, kind != PACK_NODES);
+            for (int j = 0; j < fill; j++) {
+                if (kind == PACK_SENSORS) {
+                    setSensorEntry(node, j, (SensorNode *)entries[first + j]);
+                } else if (kind == PACK_ZONES) {
+                    node->zones[j] = (BoundingBox *)entries[first + j];
+                    setEntryBox(node, j, node->zones[j]);
+                } else {
+                    setChildEntry(node, j, (RTreeNode *)entries[first + j]);
+                    node->children[j]->parent = node;
+                }
+            }
+            node->num_entries = fill;
+            if (kind == PACK_ZONES) {
+                // Zone leaves carry no readings, so only the box is computed
+                node->bbox = *node->zones[0];
+                for (int j = 1; j < fill; j++) {
+                    expandToInclude(&node->bbox, node->zones[j]);
+                }
+                initSensorAggregate(&node->aggregate);
+            } else {
+                updateBoundingBox(node);
+            }
+            level[n++] = node;
+        }
+    }
+
+    *out_count = n;
+    return level;
+}
+
+// Build a packed R-tree bottom-up from an array of sensors (Sort-Tile-Recursive).
+// The tree must be empty and the sensors allocated from its pool; the array is reordered in place.
+// As with insertOrUpdateSensor, a sensor at the same point as an earlier one only overwrites its
+// readings and is returned to the pool.
+void bulkLoadRTree(RTree *tree, SensorNode **sensors, int count) {
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        SensorNode *existing_sensor = findSensorAt(tree, sensors[i]->x, sensors[i]->y);
+        if (existing_sensor) {
+            existing_sensor->humidity = sensors[i]->humidity;
+            existing_sensor->PollutionLevel = sensors[i]->PollutionLevel;
+            existing_sensor->temperature = sensors[i]->temperature;
+            poolRelease(&tree->sensor_pool, sensors[i]);
+        } else {
+            sensorIndexInsert(&tree->index, sensors[i]);
+            sensors[unique++] = sensors[i];
+        }
+    }
+    if (unique == 0) {
+        return;
+    }
+    poolRelease(&tree->node_pool, tree->root);
+
+    tree->root = packLevels(tree, (void **)sensors, unique, PACK_SENSORS);
+}
+
+// Pack leaves of the given kind and then internal levels until a single node covers everything.
+// Returns the new root; the entries array is reordered in place.
+RTreeNode *packLevels(RTree *tree, void **entries, int count, PackKind kind) {
+    int level_count;
+    RTreeNode **level = packLevel(tree, entries, count, kind, &level_count);
+
+    while (level_count > 1) {
+        int parent_count;
+        RTreeNode **parents = packLevel(tree, (void **)level, level_count, PACK_NODES, &parent_count);
+        free(level);
+        level = parents;
+        level_count = parent_count;
+    }
+
+    RTreeNode *root = level[0];
+    free(level);
+    return root;
+}
+
+// Round a file offset up to the next page boundary
+uint64_t alignToPage(uint64_t offset) {
+    return (offset + SNAPSHOT_PAGE_SIZE - 1) / SNAPSHOT_PAGE_SIZE * SNAPSHOT_PAGE_SIZE;
+}
+
+// Stride of a sensor image: wide and aligned enough to hold a pool free-list link
+size_t snapshotSensorStride(void) {
+    return alignObjectSize(sizeof(SensorNode), sizeof(void *));
+}
+
+// 64-bit FNV-1a over the header, with the checksum field itself treated as zero
+uint64_t snapshotChecksum(SnapshotHeader *header) {
+    SnapshotHeader copy = *header;
+    copy.checksum = 0;
+    uint64_t hash = SNAPSHOT_FNV_BASIS;
+    const unsigned char *bytes = (const unsigned char *)&copy;
+    for (size_t i = 0; i < sizeof(copy); i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Fold a section into a running 64-bit FNV-1a checksum, one 64-bit word at a time.
+// Every image written to a snapshot is a whole number of words, so sections can be
+// folded image by image; the zero padding between sections is not covered.
+uint64_t snapshotSectionChecksum(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash ^= word;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Check that a stored offset names one of the count images of a section
+int snapshotOffsetValid(uint64_t offset, uint64_t section_offset, uint64_t count, uint64_t stride) {
+    return offset >= section_offset && (offset - section_offset) % stride == 0 &&
+           (offset - section_offset) / stride < count;
+}
+
+// Write zero bytes until the file position reaches offset
+int padFileTo(FILE *file, uint64_t offset) {
+    static const char zeros[SNAPSHOT_PAGE_SIZE];
+    long position = ftell(file);
+    while ((uint64_t)position < offset) {
+        size_t chunk = offset - position < sizeof(zeros) ? (size_t)(offset - position) : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, file) != chunk) {
+            return -1;
+        }
+        position += chunk;
+    }
+    return 0;
+}
+
+// Save the tree as a binary snapshot that loadRTreeSnapshot can map back in.
+// Nodes are written in breadth-first order, so offsets are known before each node is written.
+// Returns 0 on success and -1 on failure.
+int saveRTreeSnapshot(RTree *tree, const char *path) {
+    size_t node_size = sizeof(RTreeNode);
+    size_t sensor_size = snapshotSensorStride();
+
+    // Count nodes and sensors to lay out the sections
+    uint64_t node_count = 0;
+    size_t queue_capacity = 1024;
+    RTreeNode **queue = (RTreeNode **)malloc(queue_capacity * sizeof(RTreeNode *));
+    uint64_t *parent_of = (uint64_t *)malloc(queue_capacity * sizeof(uint64_t));
+    if (!queue || !parent_of) {
+        fprintf(stderr, "Memory allocation failed for snapshot queue.\n");
+        exit(EXIT_FAILURE);
+    }
+    queue[node_count] = tree->root;
+    parent_of[node_count++] = 0;
+    for (uint64_t k = 0; k < node_count; k++) {
+        RTreeNode *node = queue[k];
+        if (node->is_leaf) {
+            continue;
+        }
+        for (int i = 0; i < node->num_entries; i++) {
+            if (node_count == queue_capacity) {
+                queue_capacity *= 2;
+                RTreeNode **grown_queue = (RTreeNode **)realloc(queue, queue_capacity * sizeof(RTreeNode *));
+                uint64_t *grown_parent = (uint64_t *)realloc(parent_of, queue_capacity * sizeof(uint64_t));
+                if (!grown_queue || !grown_parent) {
+                    fprintf(stderr, "Memory allocation failed for snapshot queue.\n");
+                    exit(EXIT_FAILURE);
+                }
+                queue = grown_queue;
+                parent_of = grown_parent;
+            }
+            queue[node_count] = node->children[i];
+            parent_of[node_count++] = k;
+        }
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.max_entries = MAX_ENTRIES;
+    header.node_slots = NODE_SLOTS;
+    header.node_size = (uint32_t)node_size;
+    header.sensor_size = (uint32_t)sensor_size;
+    header.split_policy = (uint32_t)tree->policy;
+    header.coord_type = COORD_TYPE;
+    header.node_count = node_count;
+    header.node_offset = SNAPSHOT_PAGE_SIZE;
+    header.sensor_count = tree->index.count;
+    header.sensor_offset = alignToPage(header.node_offset + node_count * node_size);
+    header.index_capacity = tree->index.capacity;
+    header.index_offset = alignToPage(header.sensor_offset + header.sensor_count * sensor_size);
+    header.root_offset = header.node_offset;
+    header.file_size = header.index_offset + header.index_capacity * sizeof(uint64_t);
+    header.node_checksum = SNAPSHOT_FNV_BASIS;
+    header.sensor_checksum = SNAPSHOT_FNV_BASIS;
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open snapshot file %s for writing.\n", path);
+        free(queue);
+        free(parent_of);
+        return -1;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    SensorNode **sensors = (SensorNode **)malloc((header.sensor_count > 0 ? header.sensor_count : 1) * sizeof(SensorNode *));
+    uint64_t *sensor_leaf = (uint64_t *)malloc((header.sensor_count > 0 ? header.sensor_count : 1) * sizeof(uint64_t));
+    uint64_t *index_slots = (uint64_t *)calloc(header.index_capacity, sizeof(uint64_t));
+    RTreeNode *image = (RTreeNode *)aligned_alloc(_Alignof(RTreeNode), node_size);
+    if (!sensors || !sensor_leaf || !index_slots || !image) {
+        fprintf(stderr, "Memory allocation failed for snapshot buffers.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 && padFileTo(file, header.node_offset) == 0;
+
+    // Node images: children are numbered in queue order, sensors in leaf order
+    uint64_t next_child = 1, next_sensor = 0;
+    for (uint64_t k = 0; ok && k < node_count; k++) {
+        RTreeNode *node = queue[k];
+        memset(image, 0, node_size);
+        image->is_leaf = node->is_leaf;
+        image->num_entries = node->num_entries;
+        image->bbox = node->bbox;
+        image->aggregate = node->aggregate;
+        image->parent = k == 0 ? NULL : (RTreeNode *)(uintptr_t)(header.node_offset + parent_of[k] * node_size);
+        for (int i = 0; i < node->num_entries; i++) {
+            BoundingBox entry_bbox = getEntryBox(node, i);
+            setEntryBox(image, i, &entry_bbox);
+            if (node->is_leaf) {
+                if (next_sensor == header.sensor_count) {
+                    fprintf(stderr, "Error: Tree holds sensors missing from its index.\n");
+                    ok = 0;
+                    break;
+                }
+                sensors[next_sensor] = node->sensors[i];
+                sensor_leaf[next_sensor] = header.node_offset + k * node_size;
+                image->sensors[i] = (SensorNode *)(uintptr_t)(header.sensor_offset + next_sensor * sensor_size);
+                next_sensor++;
+            } else {
+                image->children[i] = (RTreeNode *)(uintptr_t)(header.node_offset + next_child * node_size);
+                next_child++;
+            }
+        }
+        header.node_checksum = snapshotSectionChecksum(header.node_checksum, image, node_size);
+        ok = ok && fwrite(image, node_size, 1, file) == 1;
+    }
+    ok = ok && padFileTo(file, header.sensor_offset) == 0;
+
+    // Sensor images, and the index rebuilt over their file offsets
+    unsigned char sensor_image[sizeof(SensorNode) + sizeof(void *)];
+    SensorIndex offset_index = {NULL, header.index_capacity, 0, 0};
+    for (uint64_t j = 0; ok && j < next_sensor; j++) {
+        memset(sensor_image, 0, sensor_size);
+        memcpy(sensor_image, sensors[j], sizeof(SensorNode));
+        RTreeNode *leaf_offset = (RTreeNode *)(uintptr_t)sensor_leaf[j];
+        memcpy(sensor_image + offsetof(SensorNode, leaf), &leaf_offset, sizeof(leaf_offset));
+        header.sensor_checksum = snapshotSectionChecksum(header.sensor_checksum, sensor_image, sensor_size);
+        ok = fwrite(sensor_image, sensor_size, 1, file) == 1;
+
+        size_t slot = sensorIndexSlot(&offset_index, sensors[j]->x, sensors[j]->y);
+        while (index_slots[slot]) {
+            slot = (slot + 1) & (header.index_capacity - 1);
+        }
+        index_slots[slot] = header.sensor_offset + j * sensor_size;
+    }
+    ok = ok && padFileTo(file, header.index_offset) == 0;
+    ok = ok && fwrite(index_slots, sizeof(uint64_t), header.index_capacity, file) == header.index_capacity;
+
+    // The section checksums are only known now, so the header is written again with them
+    header.index_checksum = snapshotSectionChecksum(SNAPSHOT_FNV_BASIS, index_slots,
+                                                    header.index_capacity * sizeof(uint64_t));
+    header.checksum = snapshotChecksum(&header);
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+
+    free(image);
+    free(index_slots);
+    free(sensor_leaf);
+    free(sensors);
+    free(queue);
+    free(parent_of);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Failed to write snapshot file %s.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Open a snapshot written by saveRTreeSnapshot. The file is mapped privately and its offsets
+// are turned into pointers in place, so no node or sensor is parsed or copied. The tree stays
+// fully writable: new nodes come from the pools and the mapping is released by destroyRTree.
+// Returns NULL if the file is missing, corrupt or written by an incompatible build.
+RTree *loadRTreeSnapshot(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not open snapshot file %s.\n", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        fprintf(stderr, "Error: Snapshot file %s is truncated.\n", path);
+        close(fd);
+        return NULL;
+    }
+    unsigned char *base = (unsigned char *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map snapshot file %s.\n", path);
+        return NULL;
+    }
+
+    SnapshotHeader *header = (SnapshotHeader *)base;
+    const char *problem = NULL;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+        problem = "not a snapshot file";
+    } else if (header->checksum != snapshotChecksum(header)) {
+        problem = "header checksum mismatch";
+    } else if (header->version != SNAPSHOT_VERSION) {
+        problem = "unsupported format version";
+    } else if (header->byte_order != SNAPSHOT_BYTE_ORDER) {
+        problem = "written on a machine with a different byte order";
+    } else if (header->max_entries != MAX_ENTRIES || header->node_slots != NODE_SLOTS ||
+               header->node_size != sizeof(RTreeNode) || header->sensor_size != snapshotSensorStride()) {
+        problem = "written by a build with a different node layout";
+    } else if (header->coord_type != COORD_TYPE) {
+        problem = "written by a build with a different coordinate type";
+    } else if (header->split_policy > SPLIT_RSTAR) {
+        problem = "unknown split policy";
+    } else if (header->file_size != (uint64_t)st.st_size) {
+        problem = "file size does not match header";
+    } else if (header->node_offset != SNAPSHOT_PAGE_SIZE || header->file_size < header->node_offset ||
+               header->node_count == 0 ||
+               header->node_count > (header->file_size - header->node_offset) / header->node_size ||
+               header->sensor_offset != alignToPage(header->node_offset + header->node_count * header->node_size) ||
+               header->sensor_offset > header->file_size ||
+               header->sensor_count > (header->file_size - header->sensor_offset) / header->sensor_size ||
+               header->index_offset != alignToPage(header->sensor_offset + header->sensor_count * header->sensor_size) ||
+               header->index_offset > header->file_size ||
+               header->file_size - header->index_offset != header->index_capacity * sizeof(uint64_t) ||
+               header->index_capacity > (header->file_size - header->index_offset) / sizeof(uint64_t) ||
+               (header->index_capacity & (header->index_capacity - 1)) != 0 ||
+               header->index_capacity <= header->sensor_count || header->root_offset != header->node_offset) {
+        problem = "sections do not match the header";
+    } else if (header->node_checksum != snapshotSectionChecksum(SNAPSHOT_FNV_BASIS, base + header->node_offset,
+                                                                header->node_count * header->node_size) ||
+               header->sensor_checksum != snapshotSectionChecksum(SNAPSHOT_FNV_BASIS, base + header->sensor_offset,
+                                                                  header->sensor_count * header->sensor_size) ||
+               header->index_checksum != snapshotSectionChecksum(SNAPSHOT_FNV_BASIS, base + header->index_offset,
+                                                                 header->index_capacity * sizeof(uint64_t))) {
+        problem = "section checksum mismatch";
+    }
+
+    // Check every stored offset before swizzling it into a pointer. Nodes are stored in
+    // breadth-first order, so a parent always precedes its children; requiring that keeps a
+    // crafted file from linking a node to itself or an ancestor.
+    for (uint64_t k = 0; !problem && k < header->node_count; k++) {
+        uint64_t offset = header->node_offset + k * header->node_size;
+        RTreeNode *node = (RTreeNode *)(base + offset);
+        uint64_t parent = (uint64_t)(uintptr_t)node->parent;
+        if ((node->is_leaf != 0 && node->is_leaf != 1) || node->num_entries < 0 || node->num_entries > MAX_ENTRIES) {
+            problem = "node with an invalid entry count";
+        } else if (k == 0 ? parent != 0
+                          : !snapshotOffsetValid(parent, header->node_offset, k, header->node_size)) {
+            problem = "node with an invalid parent";
+        }
+        for (int i = 0; !problem && i < node->num_entries; i++) {
+            uint64_t child = (uint64_t)(uintptr_t)node->children[i];
+            if (node->is_leaf ? !snapshotOffsetValid(child, header->sensor_offset, header->sensor_count, header->sensor_size)
+                              : child <= offset ||
+                                    !snapshotOffsetValid(child, header->node_offset, header->node_count, header->node_size)) {
+                problem = "entry with an invalid offset";
+            }
+        }
+        if (problem) {
+            break;
+        }
+        if (node->parent) {
+            node->parent = (RTreeNode *)(base + parent);
+        }
+        for (int i = 0; i < node->num_entries; i++) {
+            node->children[i] = (RTreeNode *)(base + (uintptr_t)node->children[i]);
+        }
+    }
+    for (uint64_t j = 0; !problem && j < header->sensor_count; j++) {
+        SensorNode *sensor = (SensorNode *)(base + header->sensor_offset + j * header->sensor_size);
+        uint64_t leaf = (uint64_t)(uintptr_t)sensor->leaf;
+        if (!snapshotOffsetValid(leaf, header->node_offset, header->node_count, header->node_size)) {
+            problem = "sensor with an invalid leaf";
+            break;
+        }
+        sensor->leaf = (RTreeNode *)(base + leaf);
+    }
+    uint64_t *index_slots = (uint64_t *)(base + header->index_offset);
+    for (uint64_t i = 0; !problem && i < header->index_capacity; i++) {
+        if (!index_slots[i]) {
+            continue;
+        }
+        if (!snapshotOffsetValid(index_slots[i], header->sensor_offset, header->sensor_count, header->sensor_size)) {
+            problem = "index slot with an invalid offset";
+            break;
+        }
+        index_slots[i] = (uint64_t)(uintptr_t)(base + index_slots[i]);
+    }
+    if (problem) {
+        fprintf(stderr, "Error: Snapshot file %s rejected: %s.\n", path, problem);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    RTree *tree = createRTree((SplitPolicy)header->split_policy);
+    poolRelease(&tree->node_pool, tree->root);
+    destroySensorIndex(&tree->index);
+    tree->root = (RTreeNode *)(base + header->root_offset);
+    tree->index.slots = (SensorNode **)index_slots;
+    tree->index.capacity = header->index_capacity;
+    tree->index.count = header->sensor_count;
+    tree->index.owns_slots = 0;
+    tree->mapping = base;
+    tree->mapping_size = st.st_size;
+    return tree;
+}
+
+// Print sensor data during range queries
+void printSensor(SensorNode *sensor) {
+    printf("Sensor at " POINT_FORMAT ": Humidity = %d, Pollution Level = %d, Temperature = %d\n",
+           sensor->x, sensor->y, sensor->humidity, sensor->PollutionLevel, sensor->temperature);
+}
+// Reset a filter so that it accepts every sensor
+void initSensorFilter(SensorFilter *filter) {
+    filter->min_humidity = INT_MIN;
+    filter->max_humidity = INT_MAX;
+    filter->min_pollution = INT_MIN;
+    filter->max_pollution = INT_MAX;
+    filter->min_temperature = INT_MIN;
+    filter->max_temperature = INT_MAX;
+}
+
+// Check a sensor's readings against a filter
+int sensorMatchesFilter(SensorNode *sensor, SensorFilter *filter) {
+    return sensor->humidity >= filter->min_humidity && sensor->humidity <= filter->max_humidity &&
+           sensor->PollutionLevel >= filter->min_pollution && sensor->PollutionLevel <= filter->max_pollution &&
+           sensor->temperature >= filter->min_temperature && sensor->temperature <= filter->max_temperature;
+}
+
+// Check whether any sensor summarised by an aggregate could pass a filter; 0 means the
+// subtree's reading ranges miss the filter entirely and it can be skipped
+int aggregateMayMatchFilter(SensorAggregate *aggregate, SensorFilter *filter) {
+    return aggregate->max_humidity >= filter->min_humidity && aggregate->min_humidity <= filter->max_humidity &&
+           aggregate->max_pollution >= filter->min_pollution && aggregate->min_pollution <= filter->max_pollution &&
+           aggregate->max_temperature >= filter->min_temperature && aggregate->min_temperature <= filter->max_temperature;
+}
+
+// Squared distance from (x, y) to the nearest point of a bounding box (0 if inside)
+area_t minDistSqToBox(BoundingBox *bbox, coord_t x, coord_t y) {
+    area_t dx = x < bbox->min_x ? (area_t)bbox->min_x - x : x > bbox->max_x ? (area_t)x - bbox->max_x : 0;
+    area_t dy = y < bbox->min_y ? (area_t)bbox->min_y - y : y > bbox->max_y ? (area_t)y - bbox->max_y : 0;
+    return dx * dx + dy * dy;
+}
+
+// Entries of a node the cursor has to visit: overlap with the query box, then for radius
+// queries the distance to the centre, and at the leaves the attribute filter
+uint64_t cursorEntryMask(QueryCursor *cursor, RTreeNode *node) {
+    STAT_ADD(node_visits, 1);
+    STAT_ADD(entries_scanned, node->num_entries);
+    uint64_t mask = overlapMask(node, &cursor->query_box);
+    if (!cursor->is_circle && !cursor->has_filter) {
+        return mask;
+    }
+
+    for (uint64_t candidates = mask; candidates; candidates &= candidates - 1) {
+        int i = __builtin_ctzll(candidates);
+        if (cursor->is_circle) {
+            BoundingBox entry_bbox = getEntryBox(node, i);
+            if (minDistSqToBox(&entry_bbox, cursor->center_x, cursor->center_y) > cursor->radius_sq) {
+                mask &= ~((uint64_t)1 << i);
+                continue;
+            }
+        }
+        // Subtrees whose reading ranges miss the filter are pruned like ones outside the query
+        if (cursor->has_filter && (node->is_leaf ? !sensorMatchesFilter(node->sensors[i], &cursor->filter)
+                                                 : !aggregateMayMatchFilter(&node->children[i]->aggregate, &cursor->filter))) {
+            mask &= ~((uint64_t)1 << i);
+        }
+    }
+    return mask;
+}
+
+// Push the root of the tree if it can contain any result
+void startCursor(QueryCursor *cursor, RTreeNode *root) {
+    STAT_ADD(queries, 1);
+    cursor->depth = 0;
+    if (root->num_entries > 0 && overlaps(&root->bbox, &cursor->query_box)) {
+        cursor->stack_node[0] = root;
+        cursor->stack_mask[0] = cursorEntryMask(cursor, root);
+        cursor->depth = 1;
+    }
+}
+
+// Start a range query at the root; results are pulled with fetchRangeResults
+void openRangeCursor(QueryCursor *cursor, RTreeNode *root, BoundingBox *query_box) {
+    cursor->query_box = *query_box;
+    cursor->is_circle = 0;
+    cursor->has_filter = 0;
+    startCursor(cursor, root);
+}
+
+// Start a range query that only returns sensors passing filter, e.g. an alarm predicate
+// such as temperature above a threshold and humidity below one
+void openFilteredRangeCursor(QueryCursor *cursor, RTreeNode *root, BoundingBox *query_box, SensorFilter *filter) {
+    cursor->query_box = *query_box;
+    cursor->is_circle = 0;
+    cursor->has_filter = 1;
+    cursor->filter = *filter;
+    startCursor(cursor, root);
+}
+
+// Start a query for the sensors within radius of (center_x, center_y) that pass filter
+// (NULL for no filter); results are pulled with fetchRangeResults
+void openRadiusCursor(QueryCursor *cursor, RTreeNode *root, coord_t center_x, coord_t center_y, coord_t radius,
+                      SensorFilter *filter) {
+    cursor->query_box = (BoundingBox){center_x - radius, center_y - radius, center_x + radius, center_y + radius};
+    cursor->is_circle = 1;
+    cursor->center_x = center_x;
+    cursor->center_y = center_y;
+    cursor->radius_sq = (area_t)radius * radius;
+    cursor->has_filter = filter != NULL;
+    if (filter) {
+        cursor->filter = *filter;
+    }
+    startCursor(cursor, root);
+}
+
+// Copy up to capacity matching sensors into results and return how many were written.
+// Returns 0 once the query is exhausted; the cursor can be drained over several calls.
+int fetchRangeResults(QueryCursor *cursor, SensorNode **results, int capacity) {
+    STAT_TIMER_START;
+    int count = 0;
+    while (cursor->depth > 0 && count < capacity) {
+        int top = cursor->depth - 1;
+        RTreeNode *node = cursor->stack_node[top];
+        uint64_t mask = cursor->stack_mask[top];
+
+        if (node->is_leaf) {
+            // Drain as much of the leaf as fits in the result buffer
+            while (mask && count < capacity) {
+                results[count++] = node->sensors[__builtin_ctzll(mask)];
+                mask &= mask - 1;
+            }
+            cursor->stack_mask[top] = mask;
+            if (!mask) {
+                cursor->depth--;
+            }
+            continue;
+        }
+
+        if (!mask) {
+            cursor->depth--;
+            continue;
+        }
+
+        // Descend into the next overlapping child
+        RTreeNode *child = node->children[__builtin_ctzll(mask)];
+        cursor->stack_mask[top] = mask & (mask - 1);
+        if (cursor->depth == RTREE_MAX_HEIGHT) {
+            fprintf(stderr, "Error: Tree is deeper than RTREE_MAX_HEIGHT; skipping subtree.\n");
+            continue;
+        }
+        cursor->stack_node[cursor->depth] = child;
+        cursor->stack_mask[cursor->depth] = cursorEntryMask(cursor, child);
+        STAT_ADD(false_positives, cursor->stack_mask[cursor->depth] == 0);
+        cursor->depth++;
+    }
+    STAT_TIMER_STOP;
+    return count;
+}
+
+// Push an item onto the heap, growing it as needed
+void heapPush(MinHeap *heap, area_t key, void *item, int is_sensor) {
+    if (heap->size == heap->capacity) {
+        heap->capacity = heap->capacity ? heap->capacity * 2 : 64;
+        HeapItem *grown = (HeapItem *)realloc(heap->items, heap->capacity * sizeof(HeapItem));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for search queue.\n");
+            exit(EXIT_FAILURE);
+        }
+        heap->items = grown;
+    }
+
+    int i = heap->size++;
+    while (i > 0 && heap->items[(i - 1) / 2].key > key) {
+        heap->items[i] = heap->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->items[i] = (HeapItem){key, item, is_sensor};
+}
+
+// Remove and return the item with the smallest key; the heap must not be empty
+HeapItem heapPop(MinHeap *heap) {
+    HeapItem top = heap->items[0];
+    HeapItem last = heap->items[--heap->size];
+
+    int i = 0;
+    while (2 * i + 1 < heap->size) {
+        int child = 2 * i + 1;
+        if (child + 1 < heap->size && heap->items[child + 1].key < heap->items[child].key) {
+            child++;
+        }
+        if (heap->items[child].key >= last.key) {
+            break;
+        }
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    heap->items[i] = last;
+    return top;
+}
+
+// Release the heap's storage
+void freeHeap(MinHeap *heap) {
+    free(heap->items);
+    heap->items = NULL;
+    heap->size = heap->capacity = 0;
+}
+
+// Best-first k-nearest-neighbour search (Hjaltason and Samet). Nodes are queued by the
+// minimum distance from (x, y) to their MBR and sensors by their exact distance, so sensors
+// come off the queue in distance order. Only sensors within max_distance (negative for no
+// limit) that pass filter (NULL for none) are returned. Writes up to k results to results,
+// nearest first, and returns how many were found.
+int nearestNeighbors(RTreeNode *root, coord_t x, coord_t y, int k, coord_t max_distance, SensorFilter *filter,
+                     NeighborResult *results) {
+    MinHeap heap = {NULL, 0, 0};
+    area_t max_dist_sq = max_distance < 0 ? AREA_MAX : (area_t)max_distance * max_distance;
+    int count = 0;
+
+    if (k <= 0 || root->num_entries == 0 || minDistSqToBox(&root->bbox, x, y) > max_dist_sq) {
+        return 0;
+    }
+    STAT_ADD(queries, 1);
+    STAT_TIMER_START;
+    heapPush(&heap, minDistSqToBox(&root->bbox, x, y), root, 0);
+
+    while (heap.size > 0 && count < k) {
+        HeapItem top = heapPop(&heap);
+        if (top.is_sensor) {
+            results[count].sensor = (SensorNode *)top.item;
+            results[count].dist_sq = top.key;
+            count++;
+            continue;
+        }
+
+        RTreeNode *node = (RTreeNode *)top.item;
+        STAT_ADD(node_visits, 1);
+        STAT_ADD(entries_scanned, node->num_entries);
+        for (int i = 0; i < node->num_entries; i++) {
+            BoundingBox entry_bbox = getEntryBox(node, i);
+            area_t dist_sq = minDistSqToBox(&entry_bbox, x, y);
+            if (dist_sq > max_dist_sq) {
+                continue;
+            }
+            if (node->is_leaf) {
+                if (!filter || sensorMatchesFilter(node->sensors[i], filter)) {
+                    heapPush(&heap, dist_sq, node->sensors[i], 1);
+                }
+            } else if (!filter || aggregateMayMatchFilter(&node->children[i]->aggregate, filter)) {
+                heapPush(&heap, dist_sq, node->children[i], 0);
+            }
+        }
+    }
+
+    freeHeap(&heap);
+    STAT_TIMER_STOP;
+    return count;
+}
+
+// Find the k hottest sensors inside query_box that pass filter (NULL for no filter), hottest
+// first. Best-first search keyed on each subtree's maximum temperature: a subtree is only
+// opened once it might beat every sensor already found. Returns the number of results.
+int hottestSensors(RTreeNode *root, BoundingBox *query_box, int k, SensorFilter *filter, SensorNode **results) {
+    MinHeap heap = {NULL, 0, 0};
+    int count = 0;
+
+    if (k <= 0 || root->num_entries == 0 || !overlaps(&root->bbox, query_box) ||
+        (filter && !aggregateMayMatchFilter(&root->aggregate, filter))) {
+        return 0;
+    }
+    STAT_ADD(queries, 1);
+    STAT_TIMER_START;
+    // Keys are negated temperatures so the min-heap pops the hottest item first
+    heapPush(&heap, -(area_t)root->aggregate.max_temperature, root, 0);
+
+    while (heap.size > 0 && count < k) {
+        HeapItem top = heapPop(&heap);
+        if (top.is_sensor) {
+            results[count++] = (SensorNode *)top.item;
+            continue;
+        }
+
+        RTreeNode *node = (RTreeNode *)top.item;
+        STAT_ADD(node_visits, 1);
+        STAT_ADD(entries_scanned, node->num_entries);
+        for (uint64_t candidates = overlapMask(node, query_box); candidates; candidates &= candidates - 1) {
+            int i = __builtin_ctzll(candidates);
+            if (node->is_leaf) {
+                if (!filter || sensorMatchesFilter(node->sensors[i], filter)) {
+                    heapPush(&heap, -(area_t)node->sensors[i]->temperature, node->sensors[i], 1);
+                }
+            } else if (!filter || aggregateMayMatchFilter(&node->children[i]->aggregate, filter)) {
+                heapPush(&heap, -(area_t)node->children[i]->aggregate.max_temperature, node->children[i], 0);
+            }
+        }
+    }
+
+    freeHeap(&heap);
+    STAT_TIMER_STOP;
+    return count;
+}
+
+// Drain a cursor and print every sensor found, fetching results in batches
+int printQueryResults(QueryCursor *cursor) {
+    SensorNode *results[QUERY_BATCH_SIZE];
+    int count = 0, batch;
+
+    while ((batch = fetchRangeResults(cursor, results, QUERY_BATCH_SIZE)) > 0) {
+        for (int i = 0; i < batch; i++) {
+            printSensor(results[i]);
+        }
+        count += batch;
+    }
+    return count;
+}
+
+// Run a range query and print every sensor found
+int printRangeQuery(RTreeNode *root, BoundingBox *query_box) {
+    QueryCursor cursor;
+    openRangeCursor(&cursor, root, query_box);
+    return printQueryResults(&cursor);
+}
+
+// Number of levels in the tree, counting the leaves
+int treeHeight(RTreeNode *root) {
+    int height = 1;
+    for (RTreeNode *node = root; !node->is_leaf && node->num_entries > 0; node = node->children[0]) {
+        height++;
+    }
+    return height;
+}
+
+// Add up the readings inside query_box below node. A node whose box lies entirely inside the
+// query contributes its stored aggregate without being descended into.
+void regionAggregateNode(RTreeNode *node, BoundingBox *query_box, SensorAggregate *result) {
+    STAT_ADD(node_visits, 1);
+    STAT_ADD(entries_scanned, node->num_entries);
+    for (uint64_t candidates = overlapMask(node, query_box); candidates; candidates &= candidates - 1) {
+        int i = __builtin_ctzll(candidates);
+        if (node->is_leaf) {
+            // A point entry that overlaps the query lies inside it
+            addSensorToAggregate(result, node->sensors[i]);
+        } else if (query_box->min_x <= node->entry_min_x[i] && query_box->min_y <= node->entry_min_y[i] &&
+                   query_box->max_x >= node->entry_max_x[i] && query_box->max_y >= node->entry_max_y[i]) {
+            mergeAggregate(result, &node->children[i]->aggregate);
+        } else {
+            regionAggregateNode(node->children[i], query_box, result);
+        }
+    }
+}
+
+// Count, sum, min and max of the readings of the sensors inside query_box; returns the count
+int regionAggregate(RTreeNode *root, BoundingBox *query_box, SensorAggregate *result) {
+    STAT_ADD(queries, 1);
+    STAT_TIMER_START;
+    initSensorAggregate(result);
+    if (query_box->min_x <= root->bbox.min_x && query_box->min_y <= root->bbox.min_y &&
+        query_box->max_x >= root->bbox.max_x && query_box->max_y >= root->bbox.max_y) {
+        mergeAggregate(result, &root->aggregate);
+    } else {
+        regionAggregateNode(root, query_box, result);
+    }
+    STAT_TIMER_STOP;
+    return (int)result->count;
+}
+
+// Overwrite a sensor's readings with those of record and refresh the aggregates on its path to the root
+void updateSensorReadings(RTree *tree, SensorNode *sensor, SensorNode *record) {
+    int old_temperature = sensor->temperature;
+    sensor->humidity = record->humidity;
+    sensor->PollutionLevel = record->PollutionLevel;
+    sensor->temperature = record->temperature;
+    for (RTreeNode *node = sensor->leaf; node; node = node->parent) {
+        updateAggregate(node);
+    }
+    if (tree->standing) {
+        notifyStandingQueries(tree->standing, sensor, SENSOR_UPDATED, old_temperature);
+    }
+}
+
+// Check one subtree for validateRTree; reports each problem on stderr and returns how many were found
+int validateNode(RTree *tree, RTreeNode *node, RTreeNode *parent, int depth, int leaf_depth, size_t *sensor_count) {
+    int problems = 0;
+    if (node->parent != parent) {
+        fprintf(stderr, "Error: Node at depth %d has a wrong parent pointer.\n", depth);
+        problems++;
+    }
+    if (node->is_leaf != (depth == leaf_depth)) {
+        fprintf(stderr, "Error: %s at depth %d, but the leaves are at depth %d.\n", node->is_leaf ? "Leaf" : "Internal node",
+                depth, leaf_depth);
+        return problems + 1;
+    }
+
+    // The root may hold fewer entries (but an internal root needs two); every other node is within the fill bounds
+    int min_fill = parent ? MIN_ENTRIES : (node->is_leaf ? 0 : 2);
+    if (node->num_entries < min_fill || node->num_entries > MAX_ENTRIES) {
+        fprintf(stderr, "Error: Node at depth %d holds %d entries, outside [%d, %d].\n", depth, node->num_entries, min_fill,
+                MAX_ENTRIES);
+        problems++;
+    }
+
+    BoundingBox covered = {COORD_MAX, COORD_MAX, COORD_MIN, COORD_MIN};
+    for (int i = 0; i < node->num_entries; i++) {
+        BoundingBox entry_bbox = getEntryBox(node, i);
+        BoundingBox expected;
+        if (node->is_leaf) {
+            expected = createBoundingBoxForSensor(node->sensors[i]);
+            if (findSensorAt(tree, node->sensors[i]->x, node->sensors[i]->y) != node->sensors[i]) {
+                fprintf(stderr, "Error: Sensor " POINT_FORMAT " is missing from the coordinate index.\n",
+                        node->sensors[i]->x, node->sensors[i]->y);
+                problems++;
+            }
+            if (node->sensors[i]->leaf != node) {
+                fprintf(stderr, "Error: Sensor " POINT_FORMAT " has a wrong leaf pointer.\n", node->sensors[i]->x,
+                        node->sensors[i]->y);
+                problems++;
+            }
+            (*sensor_count)++;
+        } else {
+            expected = node->children[i]->bbox;
+            problems += validateNode(tree, node->children[i], node, depth + 1, leaf_depth, sensor_count);
+        }
+        if (memcmp(&entry_bbox, &expected, sizeof(BoundingBox)) != 0) {
+            fprintf(stderr, "Error: Entry %d of a node at depth %d does not match the box of what it points to.\n", i, depth);
+            problems++;
+        }
+        expandToInclude(&covered, &entry_bbox);
+    }
+    if (node->num_entries > 0 && memcmp(&covered, &node->bbox, sizeof(BoundingBox)) != 0) {
+        fprintf(stderr, "Error: Node at depth %d has a bounding box that is not the union of its entries.\n", depth);
+        problems++;
+    }
+    SensorAggregate stored = node->aggregate;
+    updateAggregate(node);
+    if (memcmp(&stored, &node->aggregate, sizeof(SensorAggregate)) != 0) {
+        fprintf(stderr, "Error: Node at depth %d has a stale aggregate.\n", depth);
+        node->aggregate = stored;
+        problems++;
+    }
+    return problems;
+}
+
+// Check the structural invariants of a tree: every leaf at the same depth, parent pointers,
+// fill bounds, entry boxes equal to their children's boxes, node boxes equal to the union of
+// their entries, current aggregates, and every sensor reachable and indexed. Returns the number of problems (0 = valid).
+int validateRTree(RTree *tree) {
+    size_t sensor_count = 0;
+    int problems = validateNode(tree, tree->root, NULL, 0, treeHeight(tree->root) - 1, &sensor_count);
+    if (sensor_count != tree->index.count) {
+        fprintf(stderr, "Error: Tree holds %zu sensors but the index holds %zu.\n", sensor_count, tree->index.count);
+        problems++;
+    }
+    return problems;
+}
+
+// Add the shape of the subtree under node (at the given level) to stats
+void collectNodeStats(RTreeNode *node, int level, TreeStats *stats) {
+    stats->nodes++;
+    stats->level_nodes[level]++;
+    stats->level_entries[level] += node->num_entries;
+    if (node->num_entries == 0) {
+        return;
+    }
+
+    // Dead space is estimated by inclusion-exclusion to pairs: the node's area minus the entries'
+    // areas, with the pairwise overlaps added back
+    double covered = 0, overlap = 0;
+    for (int i = 0; i < node->num_entries; i++) {
+        BoundingBox a = getEntryBox(node, i);
+        covered += (double)boxArea(&a);
+        for (int j = i + 1; j < node->num_entries; j++) {
+            BoundingBox b = getEntryBox(node, j);
+            overlap += (double)overlapArea(&a, &b);
+        }
+    }
+    double dead_space = (double)boxArea(&node->bbox) - (covered - overlap);
+    stats->level_overlap[level] += overlap;
+    stats->level_dead_space[level] += dead_space > 0 ? dead_space : 0;
+
+    if (node->is_leaf) {
+        stats->sensors += node->num_entries;
+    } else if (level > 0) {
+        for (int i = 0; i < node->num_entries; i++) {
+            collectNodeStats(node->children[i], level - 1, stats);
+        }
+    }
+}
+
+// Gather the height, per-level fill, overlap and dead space of a tree
+void collectTreeStats(RTree *tree, TreeStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->height = treeHeight(tree->root);
+    if (stats->height > RTREE_MAX_HEIGHT) {
+        fprintf(stderr, "Error: Tree is deeper than RTREE_MAX_HEIGHT; statistics are incomplete.\n");
+        stats->height = RTREE_MAX_HEIGHT;
+    }
+    collectNodeStats(tree->root, stats->height - 1, stats);
+}
+
+#ifdef RTREE_STATS
+// Add the time of one query call to the counters
+void recordQueryTime(double seconds) {
+    rtree_counters.query_seconds += seconds;
+    if (seconds > rtree_counters.max_query_seconds) {
+        rtree_counters.max_query_seconds = seconds;
+    }
+}
+
+// Copy the calling thread's counters
+void getRTreeCounters(RTreeCounters *counters) {
+    *counters = rtree_counters;
+}
+
+// Zero the calling thread's counters
+void resetRTreeCounters(void) {
+    memset(&rtree_counters, 0, sizeof(rtree_counters));
+}
+#endif
+
+// Print the shape of a tree and, in builds with RTREE_STATS, the counters of the calling thread
+void printTreeStats(RTree *tree, FILE *out) {
+    TreeStats stats;
+    collectTreeStats(tree, &stats);
+    fprintf(out, "Height %d, %zu nodes, %zu sensors, fanout %d-%d\n", stats.height, stats.nodes, stats.sensors,
+            MIN_ENTRIES, MAX_ENTRIES);
+    fprintf(out, "%5s %10s %12s %6s %16s %16s\n", "Level", "Nodes", "Entries", "Fill", "Overlap", "Dead space");
+    for (int level = stats.height - 1; level >= 0; level--) {
+        double fill = stats.level_nodes[level]
+                          ? 100.0 * stats.level_entries[level] / ((double)stats.level_nodes[level] * MAX_ENTRIES)
+                          : 0;
+        fprintf(out, "%5d %10zu %12zu %5.1f%% %16.6g %16.6g\n", level, stats.level_nodes[level],
+                stats.level_entries[level], fill, stats.level_overlap[level], stats.level_dead_space[level]);
+    }
+
+#ifdef RTREE_STATS
+    RTreeCounters *c = &rtree_counters;
+    fprintf(out, "Queries: %llu (%.3f ms in total, slowest %.3f ms)\n", c->queries, c->query_seconds * 1e3,
+            c->max_query_seconds * 1e3);
+    fprintf(out, "Node visits: %llu, entries scanned: %llu, false positives: %llu\n", c->node_visits,
+            c->entries_scanned, c->false_positives);
+    fprintf(out, "Splits: %llu, R* reinsertions: %llu, merges: %llu\n", c->splits, c->reinserts, c->merges);
+    fprintf(out, "Pool allocations: %llu, releases: %llu, new slabs: %llu\n", c->pool_allocs, c->pool_releases,
+            c->slab_allocs);
+#else
+    fprintf(out, "Build with -DRTREE_STATS to count node visits, splits and allocations.\n");
+#endif
+}
+
+// Record one (query, sensor) hit, growing the hit buffers as needed
+void addMultiQueryHit(MultiQueryScratch *scratch, int query, SensorNode *sensor) {
+    if (scratch->num_hits == scratch->hit_capacity) {
+        scratch->hit_capacity = scratch->hit_capacity ? scratch->hit_capacity * 2 : 1024;
+        int *grown_query = (int *)realloc(scratch->hit_query, scratch->hit_capacity * sizeof(int));
+        SensorNode **grown_sensor = (SensorNode **)realloc(scratch->hit_sensor, scratch->hit_capacity * sizeof(SensorNode *));
+        if (!grown_query || !grown_sensor) {
+            fprintf(stderr, "Memory allocation failed for multi-query results.\n");
+            exit(EXIT_FAILURE);
+        }
+        scratch->hit_query = grown_query;
+        scratch->hit_sensor = grown_sensor;
+    }
+    scratch->hit_query[scratch->num_hits] = query;
+    scratch->hit_sensor[scratch->num_hits] = sensor;
+    scratch->num_hits++;
+}
+
+// Visit a node with the queries (active[0 .. num_active)) whose boxes overlap it.
+// Each node's entries are tested against every still-active query while the node is in cache.
+void multiRangeQueryNode(MultiQueryScratch *scratch, RTreeNode *node, int level, int num_active) {
+    int *active = scratch->active + (size_t)level * scratch->num_queries;
+    uint64_t *masks = scratch->masks + (size_t)level * scratch->num_queries;
+
+    uint64_t any = 0;
+    for (int q = 0; q < num_active; q++) {
+        masks[q] = overlapMask(node, &scratch->queries[active[q]]);
+        any |= masks[q];
+    }
+    STAT_ADD(node_visits, 1);
+    STAT_ADD(entries_scanned, (unsigned long long)node->num_entries * num_active);
+    STAT_ADD(false_positives, any == 0);
+
+    if (node->is_leaf) {
+        for (int q = 0; q < num_active; q++) {
+            for (uint64_t mask = masks[q]; mask; mask &= mask - 1) {
+                addMultiQueryHit(scratch, active[q], node->sensors[__builtin_ctzll(mask)]);
+            }
+        }
+        return;
+    }
+
+    if (level + 1 == RTREE_MAX_HEIGHT) {
+        fprintf(stderr, "Error: Tree is deeper than RTREE_MAX_HEIGHT; skipping subtree.\n");
+        return;
+    }
+
+    // Carry only the queries that overlap each child down into it
+    int *child_active = scratch->active + (size_t)(level + 1) * scratch->num_queries;
+    while (any) {
+        int i = __builtin_ctzll(any);
+        any &= any - 1;
+
+        int num_child_active = 0;
+        for (int q = 0; q < num_active; q++) {
+            if (masks[q] >> i & 1) {
+                child_active[num_child_active++] = active[q];
+            }
+        }
+        multiRangeQueryNode(scratch, node->children[i], level + 1, num_child_active);
+    }
+}
+
+// Run a batch of range queries in a single traversal of the tree. The hits come back grouped
+// by query in result (offsets plus sensors); release them with freeMultiQueryResult.
+// Returns the total number of hits.
+int multiRangeQuery(RTreeNode *root, BoundingBox *queries, int num_queries, MultiQueryResult *result) {
+    MultiQueryScratch scratch = {queries, num_queries, NULL, NULL, NULL, NULL, 0, 0};
+    STAT_ADD(queries, num_queries);
+    STAT_TIMER_START;
+    int height = treeHeight(root);
+    if (height > RTREE_MAX_HEIGHT) {
+        height = RTREE_MAX_HEIGHT;
+    }
+
+    if (num_queries > 0 && root->num_entries > 0) {
+        scratch.active = (int *)malloc((size_t)height * num_queries * sizeof(int));
+        scratch.masks = (uint64_t *)malloc((size_t)height * num_queries * sizeof(uint64_t));
+        if (!scratch.active || !scratch.masks) {
+            fprintf(stderr, "Memory allocation failed for multi-query scratch space.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        int num_active = 0;
+        for (int q = 0; q < num_queries; q++) {
+            if (overlaps(&root->bbox, &queries[q])) {
+                scratch.active[num_active++] = q;
+            }
+        }
+        if (num_active > 0) {
+            multiRangeQueryNode(&scratch, root, 0, num_active);
+        }
+    }
+
+    free(scratch.active);
+    free(scratch.masks);
+    STAT_TIMER_STOP;
+    return groupMultiQueryHits(&scratch, result);
+}
+
+// Group the (query, sensor) hits collected in scratch by query with a counting sort, filling
+// result and releasing the hit buffers. Returns the total number of hits.
+int groupMultiQueryHits(MultiQueryScratch *scratch, MultiQueryResult *result) {
+    int num_queries = scratch->num_queries;
+    result->num_queries = num_queries;
+    result->offsets = (int *)calloc(num_queries + 1, sizeof(int));
+    if (!result->offsets) {
+        fprintf(stderr, "Memory allocation failed for multi-query offsets.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int h = 0; h < scratch->num_hits; h++) {
+        result->offsets[scratch->hit_query[h] + 1]++;
+    }
+    for (int q = 0; q < num_queries; q++) {
+        result->offsets[q + 1] += result->offsets[q];
+    }
+
+    result->num_results = scratch->num_hits;
+    result->sensors = (SensorNode **)malloc((scratch->num_hits > 0 ? scratch->num_hits : 1) * sizeof(SensorNode *));
+    if (!result->sensors) {
+        fprintf(stderr, "Memory allocation failed for multi-query results.\n");
+        exit(EXIT_FAILURE);
+    }
+    int *fill = (int *)malloc((num_queries > 0 ? num_queries : 1) * sizeof(int));
+    if (!fill) {
+        fprintf(stderr, "Memory allocation failed for multi-query scratch space.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int q = 0; q < num_queries; q++) {
+        fill[q] = result->offsets[q];
+    }
+    for (int h = 0; h < scratch->num_hits; h++) {
+        result->sensors[fill[scratch->hit_query[h]]++] = scratch->hit_sensor[h];
+    }
+
+    free(fill);
+    free(scratch->hit_query);
+    free(scratch->hit_sensor);
+    scratch->hit_query = NULL;
+    scratch->hit_sensor = NULL;
+    scratch->num_hits = 0;
+    scratch->hit_capacity = 0;
+    return result->num_results;
+}
+
+// Release the buffers of a multi-query result
+void freeMultiQueryResult(MultiQueryResult *result) {
+    free(result->offsets);
+    free(result->sensors);
+    result->offsets = NULL;
+    result->sensors = NULL;
+    result->num_queries = 0;
+    result->num_results = 0;
+}
+
+// Box grown by distance on every side
+BoundingBox growBox(BoundingBox *box, coord_t distance) {
+    BoundingBox grown = {box->min_x - distance, box->min_y - distance, box->max_x + distance, box->max_y + distance};
+    return grown;
+}
+
+// Store the intersection of two boxes in *out; returns 0 if they do not intersect
+int intersectBoxes(BoundingBox *a, BoundingBox *b, BoundingBox *out) {
+    out->min_x = a->min_x > b->min_x ? a->min_x : b->min_x;
+    out->min_y = a->min_y > b->min_y ? a->min_y : b->min_y;
+    out->max_x = a->max_x < b->max_x ? a->max_x : b->max_x;
+    out->max_y = a->max_y < b->max_y ? a->max_y : b->max_y;
+    return out->min_x <= out->max_x && out->min_y <= out->max_y;
+}
+
+// Collect the entries of a node that (grown by distance) overlap window, sorted by min_x for the sweep.
+// Entries outside the window cannot pair with anything in the other node and are dropped here.
+int collectSweepEntries(RTreeNode *node, BoundingBox *window, coord_t distance, SweepEntry *entries) {
+    BoundingBox probe = growBox(window, distance);
+    int count = 0;
+    for (uint64_t mask = overlapMask(node, &probe); mask; mask &= mask - 1) {
+        int i = __builtin_ctzll(mask);
+        BoundingBox entry = {node->entry_min_x[i] - distance, node->entry_min_y[i] - distance,
+                             node->entry_max_x[i] + distance, node->entry_max_y[i] + distance};
+
+        // Insertion sort: a node holds at most NODE_SLOTS entries
+        int j = count++;
+        while (j > 0 && entries[j - 1].box.min_x > entry.min_x) {
+            entries[j] = entries[j - 1];
+            j--;
+        }
+        entries[j].box = entry;
+        entries[j].index = i;
+    }
+    return count;
+}
+
+// Record one joined pair of leaf entries
+void emitJoinPair(JoinScratch *scratch, RTreeNode *left, int i, RTreeNode *right, int j) {
+    if (scratch->zones) {
+        addMultiQueryHit(scratch->hits, (int)(right->zones[j] - scratch->zones), left->sensors[i]);
+        return;
+    }
+
+    SensorPairs *pairs = scratch->pairs;
+    if (pairs->count == pairs->capacity) {
+        pairs->capacity = pairs->capacity ? pairs->capacity * 2 : 1024;
+        SensorNode **grown_left = (SensorNode **)realloc(pairs->left, pairs->capacity * sizeof(SensorNode *));
+        SensorNode **grown_right = (SensorNode **)realloc(pairs->right, pairs->capacity * sizeof(SensorNode *));
+        if (!grown_left || !grown_right) {
+            fprintf(stderr, "Memory allocation failed for join results.\n");
+            exit(EXIT_FAILURE);
+        }
+        pairs->left = grown_left;
+        pairs->right = grown_right;
+    }
+    pairs->left[pairs->count] = left->sensors[i];
+    pairs->right[pairs->count] = right->sensors[j];
+    pairs->count++;
+}
+
+void joinNodes(JoinScratch *scratch, RTreeNode *left, RTreeNode *right);
+
+// Join one pair of entries found by the sweep: emit it at the leaves, otherwise descend into both
+void joinEntries(JoinScratch *scratch, RTreeNode *left, int i, RTreeNode *right, int j) {
+    if (left->is_leaf) {
+        emitJoinPair(scratch, left, i, right, j);
+    } else {
+        joinNodes(scratch, left->children[i], right->children[j]);
+    }
+}
+
+// Synchronized traversal of two subtrees (Brinkhoff, Kriegel and Seeger). Only entries inside
+// the intersection of the two node boxes take part, and the candidate pairs are found with a
+// plane sweep along x instead of testing every combination. When the trees have different
+// heights only the deeper side descends until both reach the same kind of node.
+void joinNodes(JoinScratch *scratch, RTreeNode *left, RTreeNode *right) {
+    coord_t distance = scratch->distance;
+    BoundingBox grown = growBox(&left->bbox, distance);
+    BoundingBox window;
+    if (!intersectBoxes(&grown, &right->bbox, &window)) {
+        return;
+    }
+
+    if (left->is_leaf != right->is_leaf) {
+        if (!left->is_leaf) {
+            BoundingBox probe = growBox(&window, distance);
+            for (uint64_t mask = overlapMask(left, &probe); mask; mask &= mask - 1) {
+                joinNodes(scratch, left->children[__builtin_ctzll(mask)], right);
+            }
+        } else {
+            for (uint64_t mask = overlapMask(right, &window); mask; mask &= mask - 1) {
+                joinNodes(scratch, left, right->children[__builtin_ctzll(mask)]);
+            }
+        }
+        return;
+    }
+
+    SweepEntry left_entries[NODE_SLOTS];
+    SweepEntry right_entries[NODE_SLOTS];
+    int num_left = collectSweepEntries(left, &window, distance, left_entries);
+    int num_right = collectSweepEntries(right, &window, 0, right_entries);
+
+    // Take the entry with the smaller min_x and pair it with every entry of the other side
+    // that starts before it ends; the y test finishes the overlap check
+    int a = 0, b = 0;
+    while (a < num_left && b < num_right) {
+        if (left_entries[a].box.min_x <= right_entries[b].box.min_x) {
+            BoundingBox *box = &left_entries[a].box;
+            for (int k = b; k < num_right && right_entries[k].box.min_x <= box->max_x; k++) {
+                if (right_entries[k].box.min_y <= box->max_y && box->min_y <= right_entries[k].box.max_y) {
+                    joinEntries(scratch, left, left_entries[a].index, right, right_entries[k].index);
+                }
+            }
+            a++;
+        } else {
+            BoundingBox *box = &right_entries[b].box;
+            for (int k = a; k < num_left && left_entries[k].box.min_x <= box->max_x; k++) {
+                if (left_entries[k].box.min_y <= box->max_y && box->min_y <= left_entries[k].box.max_y) {
+                    joinEntries(scratch, left, left_entries[k].index, right, right_entries[b].index);
+                }
+            }
+            b++;
+        }
+    }
+}
+
+// Join the sensors of a tree against an array of zones: the zones are packed into a temporary
+// R-tree and both trees are traversed together. The hits come back grouped by zone exactly as
+// from multiRangeQuery; release them with freeMultiQueryResult. Returns the total number of hits.
+int spatialJoinZones(RTreeNode *root, BoundingBox *zones, int num_zones, MultiQueryResult *result) {
+    MultiQueryScratch hits = {zones, num_zones, NULL, NULL, NULL, NULL, 0, 0};
+
+    if (num_zones > 0 && root->num_entries > 0) {
+        BoundingBox **entries = (BoundingBox **)malloc(num_zones * sizeof(BoundingBox *));
+        if (!entries) {
+            fprintf(stderr, "Memory allocation failed for zone tree.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int z = 0; z < num_zones; z++) {
+            entries[z] = &zones[z];
+        }
+
+        RTree *zone_tree = createRTree(DEFAULT_SPLIT_POLICY);
+        poolRelease(&zone_tree->node_pool, zone_tree->root);
+        zone_tree->root = packLevels(zone_tree, (void **)entries, num_zones, PACK_ZONES);
+        free(entries);
+
+        JoinScratch scratch = {0, zones, &hits, NULL};
+        joinNodes(&scratch, root, zone_tree->root);
+        destroyRTree(zone_tree);
+    }
+
+    return groupMultiQueryHits(&hits, result);
+}
+
+// Find every pair of sensors, one from each tree, that lie within distance of each other on
+// both axes (distance 0 matches sensors at the same position). The pairs are stored in result;
+// release them with freeSensorPairs. Returns the number of pairs.
+int spatialJoinTrees(RTreeNode *left, RTreeNode *right, coord_t distance, SensorPairs *result) {
+    result->left = NULL;
+    result->right = NULL;
+    result->count = 0;
+    result->capacity = 0;
+
+    if (left->num_entries > 0 && right->num_entries > 0) {
+        JoinScratch scratch = {distance, NULL, NULL, result};
+        joinNodes(&scratch, left, right);
+    }
+    return result->count;
+}
+
+// Release the buffers of a tree join result
+void freeSensorPairs(SensorPairs *pairs) {
+    free(pairs->left);
+    free(pairs->right);
+    pairs->left = NULL;
+    pairs->right = NULL;
+    pairs->count = 0;
+    pairs->capacity = 0;
+}
+
+// Read zones from a text file, one "min_x min_y max_x max_y" per line. Returns a malloc'd array
+// and stores its length in *count, or returns NULL if the file cannot be read.
+BoundingBox *loadZoneFile(const char *path, int *count) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open zone file %s.\n", path);
+        return NULL;
+    }
+
+    int capacity = 1024;
+    BoundingBox *zones = (BoundingBox *)malloc(capacity * sizeof(BoundingBox));
+    if (!zones) {
+        fprintf(stderr, "Memory allocation failed for zones.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int n = 0;
+    BoundingBox zone;
+    while (fscanf(file, BOX_SCAN, &zone.min_x, &zone.min_y, &zone.max_x, &zone.max_y) == 4) {
+        if (zone.min_x > zone.max_x || zone.min_y > zone.max_y) {
+            fprintf(stderr, "Error: Skipping inverted zone %d in %s.\n", n + 1, path);
+            continue;
+        }
+        if (n == capacity) {
+            capacity *= 2;
+            BoundingBox *grown = (BoundingBox *)realloc(zones, capacity * sizeof(BoundingBox));
+            if (!grown) {
+                fprintf(stderr, "Memory allocation failed for zones.\n");
+                exit(EXIT_FAILURE);
+            }
+            zones = grown;
+        }
+        zones[n++] = zone;
+    }
+
+    fclose(file);
+    *count = n;
+    return zones;
+}
+
+// Remove a sensor from the tree's index and return it to the pool
+void discardSensor(RTree *tree, SensorNode *sensor, DeleteBatch *batch) {
+    if (tree->standing) {
+        notifyStandingQueries(tree->standing, sensor, SENSOR_REMOVED, 0);
+    }
+    sensorIndexRemove(&tree->index, sensor);
+    poolRelease(&tree->sensor_pool, sensor);
+    batch->deleted++;
+}
+
+// Discard a whole subtree that lies inside the delete region
+void discardSubtree(RTree *tree, RTreeNode *node, DeleteBatch *batch) {
+    for (int i = 0; i < node->num_entries; i++) {
+        if (node->is_leaf) {
+            discardSensor(tree, node->sensors[i], batch);
+        } else {
+            discardSubtree(tree, node->children[i], batch);
+        }
+    }
+    poolRelease(&tree->node_pool, node);
+}
+
+// Queue an underfull node whose entries must be reinserted
+void addOrphan(DeleteBatch *batch, RTreeNode *node, int level) {
+    if (batch->num_orphans == batch->orphan_capacity) {
+        batch->orphan_capacity = batch->orphan_capacity ? batch->orphan_capacity * 2 : 16;
+        RTreeNode **grown_orphans = (RTreeNode **)realloc(batch->orphans, batch->orphan_capacity * sizeof(RTreeNode *));
+        int *grown_levels = (int *)realloc(batch->orphan_levels, batch->orphan_capacity * sizeof(int));
+        if (!grown_orphans || !grown_levels) {
+            fprintf(stderr, "Memory allocation failed for delete orphans.\n");
+            exit(EXIT_FAILURE);
+        }
+        batch->orphans = grown_orphans;
+        batch->orphan_levels = grown_levels;
+    }
+    batch->orphans[batch->num_orphans] = node;
+    batch->orphan_levels[batch->num_orphans] = level;
+    batch->num_orphans++;
+    STAT_ADD(merges, 1);
+}
+
+// Remove entry i of a node by moving the last entry into its slot
+void removeEntry(RTreeNode *node, int i) {
+    node->num_entries--;
+    if (i != node->num_entries) {
+        moveEntry(node, i, node->num_entries);
+    }
+}
+
+// One delete traversal below node (at the given level). In region mode every sensor inside the
+// region goes; otherwise the sensors in targets do, and each child only sees the targets its box
+// contains. On the way back up, children that fell below MIN_ENTRIES are cut out and queued as
+// orphans, and the remaining entry boxes are tightened.
+void deleteFromSubtree(RTree *tree, RTreeNode *node, int level, SensorNode **targets, int num_targets, DeleteBatch *batch) {
+    if (node->is_leaf) {
+        // Entries are visited from the end so removeEntry only moves already-visited ones
+        for (int i = node->num_entries - 1; i >= 0; i--) {
+            SensorNode *sensor = node->sensors[i];
+            int hit = 0;
+            if (batch->by_region) {
+                hit = sensor->x >= batch->region.min_x && sensor->x <= batch->region.max_x &&
+                      sensor->y >= batch->region.min_y && sensor->y <= batch->region.max_y;
+            } else {
+                for (int t = 0; t < num_targets && !hit; t++) {
+                    hit = targets[t] == sensor;
+                }
+            }
+            if (hit) {
+                discardSensor(tree, sensor, batch);
+                removeEntry(node, i);
+            }
+        }
+        updateBoundingBox(node);
+        return;
+    }
+
+    SensorNode **child_targets = NULL;
+    if (!batch->by_region) {
+        child_targets = (SensorNode **)malloc(num_targets * sizeof(SensorNode *));
+        if (!child_targets) {
+            fprintf(stderr, "Memory allocation failed for delete targets.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t mask = batch->by_region ? overlapMask(node, &batch->region) : 0;
+    for (int i = node->num_entries - 1; i >= 0; i--) {
+        RTreeNode *child = node->children[i];
+        BoundingBox entry_bbox = getEntryBox(node, i);
+        int num_child_targets = 0;
+        if (batch->by_region) {
+            if (!(mask >> i & 1)) {
+                continue;
+            }
+            // A child entirely inside the region is dropped without visiting its entries one by one
+            if (batch->region.min_x <= entry_bbox.min_x && batch->region.min_y <= entry_bbox.min_y &&
+                batch->region.max_x >= entry_bbox.max_x && batch->region.max_y >= entry_bbox.max_y) {
+                discardSubtree(tree, child, batch);
+                removeEntry(node, i);
+                continue;
+            }
+        } else {
+            for (int t = 0; t < num_targets; t++) {
+                if (targets[t]->x >= entry_bbox.min_x && targets[t]->x <= entry_bbox.max_x &&
+                    targets[t]->y >= entry_bbox.min_y && targets[t]->y <= entry_bbox.max_y) {
+                    child_targets[num_child_targets++] = targets[t];
+                }
+            }
+            if (num_child_targets == 0) {
+                continue;
+            }
+        }
+
+        deleteFromSubtree(tree, child, level - 1, child_targets, num_child_targets, batch);
+        if (child->num_entries < MIN_ENTRIES) {
+            removeEntry(node, i);
+            child->parent = NULL;
+            addOrphan(batch, child, level - 1);
+        }
+    }
+    free(child_targets);
+    updateBoundingBox(node);
+}
+
+// Finish a delete: reinsert the orphans' entries at their own level (highest level first, so
+// the tree is still tall enough for them), then shorten the root while it has a single child
+void condenseTree(RTree *tree, DeleteBatch *batch) {
+    // If every child of the root went, the highest orphan with entries becomes the root
+    if (!tree->root->is_leaf && tree->root->num_entries == 0) {
+        int promoted = -1;
+        for (int k = 0; k < batch->num_orphans; k++) {
+            if (batch->orphans[k]->num_entries > 0 &&
+                (promoted < 0 || batch->orphan_levels[k] > batch->orphan_levels[promoted])) {
+                promoted = k;
+            }
+        }
+        poolRelease(&tree->node_pool, tree->root);
+        if (promoted >= 0) {
+            tree->root = batch->orphans[promoted];
+            batch->orphans[promoted] = NULL;
+        } else {
+            tree->root = createRTreeNode(tree, 1);
+        }
+    }
+
+    for (int top = tree->root->is_leaf ? 0 : treeHeight(tree->root) - 1; top >= 0; top--) {
+        for (int k = 0; k < batch->num_orphans; k++) {
+            RTreeNode *orphan = batch->orphans[k];
+            if (!orphan || batch->orphan_levels[k] != top) {
+                continue;
+            }
+            for (int i = 0; i < orphan->num_entries; i++) {
+                BoundingBox entry_bbox = getEntryBox(orphan, i);
+                tree->reinserted_levels = 0;
+                insertEntryAtLevel(tree, orphan->children[i], &entry_bbox, top);
+            }
+            poolRelease(&tree->node_pool, orphan);
+        }
+    }
+
+    while (!tree->root->is_leaf && tree->root->num_entries == 1) {
+        RTreeNode *old_root = tree->root;
+        tree->root = old_root->children[0];
+        tree->root->parent = NULL;
+        poolRelease(&tree->node_pool, old_root);
+    }
+
+    free(batch->orphans);
+    free(batch->orphan_levels);
+}
+
+// Run one delete traversal from the root; returns the number of sensors deleted
+int runDeleteBatch(RTree *tree, DeleteBatch *batch, SensorNode **targets, int num_targets) {
+    batch->deleted = 0;
+    batch->orphans = NULL;
+    batch->orphan_levels = NULL;
+    batch->num_orphans = 0;
+    batch->orphan_capacity = 0;
+    deleteFromSubtree(tree, tree->root, treeHeight(tree->root) - 1, targets, num_targets, batch);
+    condenseTree(tree, batch);
+    return batch->deleted;
+}
+
+// Delete the sensor at the given coordinates; returns 1 if it was in the tree
+int deleteSensorFromRTree(RTree *tree, SensorNode *sensor) {
+    SensorNode *existing_sensor = findSensorAt(tree, sensor->x, sensor->y);
+    if (!existing_sensor) {
+        return 0;
+    }
+    DeleteBatch batch;
+    batch.by_region = 0;
+    return runDeleteBatch(tree, &batch, &existing_sensor, 1);
+}
+
+// Delete every sensor inside a region in one traversal; returns how many were deleted
+int deleteSensorsInRegion(RTree *tree, BoundingBox *region) {
+    DeleteBatch batch;
+    batch.by_region = 1;
+    batch.region = *region;
+    return runDeleteBatch(tree, &batch, NULL, 0);
+}
+
+// Delete the sensors at the coordinates of the given records in one traversal;
+// records with no sensor are ignored. Returns how many were deleted.
+int deleteSensorList(RTree *tree, SensorNode *records, int count) {
+    SensorNode **targets = (SensorNode **)malloc((count > 0 ? count : 1) * sizeof(SensorNode *));
+    if (!targets) {
+        fprintf(stderr, "Memory allocation failed for delete targets.\n");
+        exit(EXIT_FAILURE);
+    }
+    int num_targets = 0;
+    for (int i = 0; i < count; i++) {
+        SensorNode *existing_sensor = findSensorAt(tree, records[i].x, records[i].y);
+        if (existing_sensor) {
+            // Take listed sensors out of the index for now so repeated coordinates are listed once
+            sensorIndexRemove(&tree->index, existing_sensor);
+            targets[num_targets++] = existing_sensor;
+        }
+    }
+    for (int t = 0; t < num_targets; t++) {
+        sensorIndexInsert(&tree->index, targets[t]);
+    }
+
+    DeleteBatch batch;
+    batch.by_region = 0;
+    int deleted = num_targets > 0 ? runDeleteBatch(tree, &batch, targets, num_targets) : 0;
+    free(targets);
+    return deleted;
+}
+
+// Search for a sensor with specific coordinates in the R-tree
+SensorNode *searchSensorInRTree(RTreeNode *node, SensorNode *target) {
+    // A point query matches exactly the sensors at the target's coordinates
+    BoundingBox targetBBox = createBoundingBoxForSensor(target);
+    QueryCursor cursor;
+    SensorNode *result;
+
+    openRangeCursor(&cursor, node, &targetBBox);
+    if (fetchRangeResults(&cursor, &result, 1) == 1) {
+        return result;
+    }
+    return NULL;  // Sensor not found
+}
+
+// Build a tree instance holding copies of the given sensor records
+RTree *createRTreeFromRecords(SensorNode *records, int count) {
+    RTree *tree = createRTree(DEFAULT_SPLIT_POLICY);
+    SensorNode **sensors = (SensorNode **)malloc((count > 0 ? count : 1) * sizeof(SensorNode *));
+    if (!sensors) {
+        fprintf(stderr, "Memory allocation failed for sensor list.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < count; i++) {
+        sensors[i] = createSensorNode(tree);
+        *sensors[i] = records[i];
+    }
+    bulkLoadRTree(tree, sensors, count);
+    free(sensors);
+    return tree;
+}
+
+// Create a concurrent tree: both instances are bulk loaded from the same records
+ConcurrentRTree *createConcurrentRTree(SensorNode *records, int count) {
+    return wrapConcurrentRTree(createRTreeFromRecords(records, count), createRTreeFromRecords(records, count));
+}
+
+// Create a concurrent tree over two trees holding the same sensors, e.g. two loads of one
+// snapshot; it takes ownership of both
+ConcurrentRTree *wrapConcurrentRTree(RTree *first, RTree *second) {
+    ConcurrentRTree *ctree = (ConcurrentRTree *)aligned_alloc(_Alignof(ConcurrentRTree), sizeof(ConcurrentRTree));
+    if (!ctree) {
+        fprintf(stderr, "Memory allocation failed for ConcurrentRTree.\n");
+        exit(EXIT_FAILURE);
+    }
+    ctree->instances[0] = first;
+    ctree->instances[1] = second;
+    atomic_init(&ctree->left_right, 0);
+    atomic_init(&ctree->version_index, 0);
+    for (int side = 0; side < 2; side++) {
+        for (int i = 0; i < READER_STRIPES; i++) {
+            atomic_init(&ctree->readers[side].stripes[i].count, 0);
+        }
+    }
+    pthread_mutex_init(&ctree->writer_lock, NULL);
+    return ctree;
+}
+
+// Destroy a concurrent tree; no reader or writer may still be using it
+void destroyConcurrentRTree(ConcurrentRTree *ctree) {
+    destroyRTree(ctree->instances[0]);
+    destroyRTree(ctree->instances[1]);
+    pthread_mutex_destroy(&ctree->writer_lock);
+    free(ctree);
+}
+
+// Stripe used by the calling thread, assigned round-robin on first use
+int readerStripe(void) {
+    static atomic_int next_stripe;
+    static _Thread_local int stripe = -1;
+    if (stripe < 0) {
+        stripe = atomic_fetch_add(&next_stripe, 1) % READER_STRIPES;
+    }
+    return stripe;
+}
+
+// Enter a read section and return the instance to read. The tree and every sensor in it
+// stay unchanged until endConcurrentRead; copy out anything needed after that.
+RTree *beginConcurrentRead(ConcurrentRTree *ctree, ReadTicket *ticket) {
+    ticket->stripe = readerStripe();
+    ticket->version = atomic_load(&ctree->version_index);
+    atomic_fetch_add(&ctree->readers[ticket->version].stripes[ticket->stripe].count, 1);
+    return ctree->instances[atomic_load(&ctree->left_right)];
+}
+
+// Leave a read section started with beginConcurrentRead
+void endConcurrentRead(ConcurrentRTree *ctree, ReadTicket *ticket) {
+    atomic_fetch_sub(&ctree->readers[ticket->version].stripes[ticket->stripe].count, 1);
+}
+
+// Spin (yielding) until no reader is registered on the given indicator
+void waitForReaders(ReaderIndicator *indicator) {
+    for (int i = 0; i < READER_STRIPES; i++) {
+        while (atomic_load(&indicator->stripes[i].count) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+// Apply a write to both instances: first to the one readers are not using, then switch
+// readers over and apply it to the other once the readers still on it have left
+void applyConcurrentWrite(ConcurrentRTree *ctree, TreeWriteOp op, void *arg) {
+    pthread_mutex_lock(&ctree->writer_lock);
+
+    int left_right = atomic_load(&ctree->left_right);
+    op(ctree->instances[!left_right], arg);
+    atomic_store(&ctree->left_right, !left_right);
+
+    int version = atomic_load(&ctree->version_index);
+    waitForReaders(&ctree->readers[!version]);
+    atomic_store(&ctree->version_index, !version);
+    waitForReaders(&ctree->readers[version]);
+
+    op(ctree->instances[left_right], arg);
+
+    pthread_mutex_unlock(&ctree->writer_lock);
+}
+
+// Thread-safe range query: copies up to capacity matching sensors into results and
+// returns the total number of matches
+int concurrentRangeQuery(ConcurrentRTree *ctree, BoundingBox *query_box, SensorNode *results, int capacity) {
+    SensorNode *batch[QUERY_BATCH_SIZE];
+    QueryCursor cursor;
+    ReadTicket ticket;
+    int count = 0, fetched;
+
+    RTree *tree = beginConcurrentRead(ctree, &ticket);
+    openRangeCursor(&cursor, tree->root, query_box);
+    while ((fetched = fetchRangeResults(&cursor, batch, QUERY_BATCH_SIZE)) > 0) {
+        for (int i = 0; i < fetched; i++, count++) {
+            if (count < capacity) {
+                results[count] = *batch[i];
+            }
+        }
+    }
+    endConcurrentRead(ctree, &ticket);
+    return count;
+}
+
+// Thread-safe point lookup; copies the sensor into result and returns 1 if it exists
+int concurrentSearchSensor(ConcurrentRTree *ctree, coord_t x, coord_t y, SensorNode *result) {
+    SensorNode target = {x, y, 0, 0, 0, NULL};
+    ReadTicket ticket;
+
+    RTree *tree = beginConcurrentRead(ctree, &ticket);
+    SensorNode *found = searchSensorInRTree(tree->root, &target);
+    if (found) {
+        *result = *found;
+    }
+    endConcurrentRead(ctree, &ticket);
+    return found != NULL;
+}
+
+// Thread-safe region aggregate
+int concurrentRegionAggregate(ConcurrentRTree *ctree, BoundingBox *query_box, SensorAggregate *result) {
+    ReadTicket ticket;
+    RTree *tree = beginConcurrentRead(ctree, &ticket);
+    int count = regionAggregate(tree->root, query_box, result);
+    endConcurrentRead(ctree, &ticket);
+    return count;
+}
+
+// Write operations applied to each instance by applyConcurrentWrite
+void insertRecordOp(RTree *tree, void *arg) {
+    insertOrUpdateSensor(tree, (SensorNode *)arg);
+}
+
+void deleteRecordOp(RTree *tree, void *arg) {
+    deleteSensorFromRTree(tree, (SensorNode *)arg);
+}
+
+void updateRecordOp(RTree *tree, void *arg) {
+    SensorNode *record = (SensorNode *)arg;
+    SensorNode *existing_sensor = findSensorAt(tree, record->x, record->y);
+    if (existing_sensor) {
+        updateSensorReadings(tree, existing_sensor, record);
+    }
+}
+
+// Thread-safe insert of a copy of record, with the same duplicate rule as insertOrUpdateSensor
+void concurrentInsertSensor(ConcurrentRTree *ctree, SensorNode *record) {
+    applyConcurrentWrite(ctree, insertRecordOp, record);
+}
+
+// Thread-safe delete of the sensor at (x, y)
+void concurrentDeleteSensor(ConcurrentRTree *ctree, coord_t x, coord_t y) {
+    SensorNode target = {x, y, 0, 0, 0, NULL};
+    applyConcurrentWrite(ctree, deleteRecordOp, &target);
+}
+
+// Thread-safe overwrite of the readings of the sensor at (record->x, record->y)
+void concurrentUpdateSensor(ConcurrentRTree *ctree, SensorNode *record) {
+    applyConcurrentWrite(ctree, updateRecordOp, record);
+}
+
+// Allocate an empty columns x rows grid over extent
+void initRaster(Raster *raster, BoundingBox *extent, int columns, int rows) {
+    size_t cells = (size_t)columns * rows;
+    raster->extent = *extent;
+    raster->columns = columns;
+    raster->rows = rows;
+    raster->count = (long long *)calloc(cells, sizeof(long long));
+    raster->sum = (long long *)calloc(cells, sizeof(long long));
+    raster->max = (int *)malloc(cells * sizeof(int));
+    if (!raster->count || !raster->sum || !raster->max) {
+        fprintf(stderr, "Memory allocation failed for raster.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t c = 0; c < cells; c++) {
+        raster->max[c] = INT_MIN;
+    }
+}
+
+// Release the cells of a raster
+void freeRaster(Raster *raster) {
+    free(raster->count);
+    free(raster->sum);
+    free(raster->max);
+    raster->count = NULL;
+    raster->sum = NULL;
+    raster->max = NULL;
+}
+
+// Cell of value along an axis from low to high cut into cells equal parts (value must lie
+// inside). Integer extents include both ends, so their span counts one extra unit.
+int rasterCell(coord_t value, coord_t low, coord_t high, int cells) {
+#if COORD_IS_INTEGER
+    area_t span = (area_t)high - low + 1;
+#else
+    area_t span = (area_t)high - low;
+    if (span <= 0) {
+        return 0;
+    }
+#endif
+    int cell = (int)(((area_t)value - low) * cells / span);
+    return cell < cells ? cell : cells - 1;
+}
+
+// Column and row of the cell holding coordinate x or y
+int rasterColumn(Raster *raster, coord_t x) {
+    return rasterCell(x, raster->extent.min_x, raster->extent.max_x, raster->columns);
+}
+
+int rasterRow(Raster *raster, coord_t y) {
+    return rasterCell(y, raster->extent.min_y, raster->extent.max_y, raster->rows);
+}
+
+// Add count sensors with the given temperature sum and maximum to one cell
+void addToRasterCell(Raster *raster, int column, int row, long long count, long long sum, int max) {
+    size_t cell = (size_t)row * raster->columns + column;
+    raster->count[cell] += count;
+    raster->sum[cell] += sum;
+    if (max > raster->max[cell]) {
+        raster->max[cell] = max;
+    }
+}
+
+// Accumulate the sensors below node into the raster. A subtree whose box lies inside a single
+// cell is added from its aggregate in one step instead of being visited sensor by sensor.
+void rasterizeNode(Raster *raster, RTreeNode *node) {
+    BoundingBox *box = &node->bbox;
+    BoundingBox *extent = &raster->extent;
+    if (box->min_x >= extent->min_x && box->max_x <= extent->max_x &&
+        box->min_y >= extent->min_y && box->max_y <= extent->max_y) {
+        int column = rasterColumn(raster, box->min_x);
+        int row = rasterRow(raster, box->min_y);
+        if (column == rasterColumn(raster, box->max_x) && row == rasterRow(raster, box->max_y)) {
+            addToRasterCell(raster, column, row, node->aggregate.count, node->aggregate.sum_temperature,
+                            node->aggregate.max_temperature);
+            return;
+        }
+    }
+
+    for (uint64_t mask = overlapMask(node, extent); mask; mask &= mask - 1) {
+        int i = __builtin_ctzll(mask);
+        if (node->is_leaf) {
+            SensorNode *sensor = node->sensors[i];
+            addToRasterCell(raster, rasterColumn(raster, sensor->x), rasterRow(raster, sensor->y), 1,
+                            sensor->temperature, sensor->temperature);
+        } else {
+            rasterizeNode(raster, node->children[i]);
+        }
+    }
+}
+
+// Clear the raster and fill it with the sensors of the tree that lie inside its extent
+void rasterizeTree(Raster *raster, RTreeNode *root) {
+    size_t cells = (size_t)raster->columns * raster->rows;
+    memset(raster->count, 0, cells * sizeof(long long));
+    memset(raster->sum, 0, cells * sizeof(long long));
+    for (size_t c = 0; c < cells; c++) {
+        raster->max[c] = INT_MIN;
+    }
+    if (root->num_entries > 0 && overlaps(&root->bbox, &raster->extent)) {
+        rasterizeNode(raster, root);
+    }
+}
+
+// Value of one cell in the given mode; returns 0 if no sensor fell into it
+int rasterCellValue(Raster *raster, RasterMode mode, size_t cell, double *value) {
+    if (raster->count[cell] == 0) {
+        return 0;
+    }
+    *value = mode == RASTER_MAX ? raster->max[cell] : (double)raster->sum[cell] / raster->count[cell];
+    return 1;
+}
+
+// Map a temperature onto the blue-cyan-green-yellow-red heatmap palette
+void heatmapColor(double temperature, unsigned char *rgb) {
+    static const double stops[] = {0.0, 1.0 / 7, 3.0 / 7, 5.0 / 7, 1.0};
+    static const unsigned char colors[][3] = {{0, 0, 255}, {0, 255, 255}, {0, 255, 0}, {255, 255, 0}, {255, 0, 0}};
+    double t = (temperature - HEATMAP_MIN_TEMPERATURE) / (HEATMAP_MAX_TEMPERATURE - HEATMAP_MIN_TEMPERATURE);
+    t = t < 0 ? 0 : t > 1 ? 1 : t;
+
+    int s = 0;
+    while (s < 3 && t > stops[s + 1]) {
+        s++;
+    }
+    double f = (t - stops[s]) / (stops[s + 1] - stops[s]);
+    for (int c = 0; c < 3; c++) {
+        rgb[c] = (unsigned char)(colors[s][c] + (colors[s + 1][c] - colors[s][c]) * f + 0.5);
+    }
+}
+
+// Write the raster as one frame: a CSV grid of cell values if path ends in ".csv" (empty cells
+// left blank), otherwise a binary PPM image with empty cells drawn white. Rows are written top
+// (highest y) first. Returns 0 on success, -1 on error.
+int writeRasterFrame(Raster *raster, RasterMode mode, const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open %s for writing.\n", path);
+        return -1;
+    }
+
+    size_t path_length = strlen(path);
+    int csv = path_length >= 4 && strcmp(path + path_length - 4, ".csv") == 0;
+    double value;
+    int failed = 0;
+    if (csv) {
+        setvbuf(file, NULL, _IOFBF, READER_CHUNK_SIZE);
+        for (int row = raster->rows - 1; row >= 0; row--) {
+            for (int column = 0; column < raster->columns; column++) {
+                if (column > 0) {
+                    fputc(',', file);
+                }
+                if (rasterCellValue(raster, mode, (size_t)row * raster->columns + column, &value)) {
+                    fprintf(file, "%.2f", value);
+                }
+            }
+            fputc('\n', file);
+        }
+        failed = ferror(file);
+    } else {
+        // Build the whole image in memory and write it with a single call
+        char header[64];
+        int header_length = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", raster->columns, raster->rows);
+        size_t pixels = (size_t)raster->columns * raster->rows;
+        unsigned char *image = (unsigned char *)malloc(header_length + pixels * 3);
+        if (!image) {
+            fprintf(stderr, "Memory allocation failed for heatmap image.\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(image, header, header_length);
+        unsigned char *pixel = image + header_length;
+        for (int row = raster->rows - 1; row >= 0; row--) {
+            for (int column = 0; column < raster->columns; column++, pixel += 3) {
+                if (rasterCellValue(raster, mode, (size_t)row * raster->columns + column, &value)) {
+                    heatmapColor(value, pixel);
+                } else {
+                    pixel[0] = pixel[1] = pixel[2] = 255;
+                }
+            }
+        }
+        failed = fwrite(image, 1, header_length + pixels * 3, file) != header_length + pixels * 3;
+        free(image);
+    }
+
+    // A full disk may only show up when the buffered tail is flushed by fclose
+    if (fclose(file) != 0 || failed) {
+        fprintf(stderr, "Error: Could not write %s.\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Rasterize the sensors inside extent on a HEATMAP_SIZE x HEATMAP_SIZE grid and write the frame to path
+int writeHeatmap(RTreeNode *root, BoundingBox *extent, RasterMode mode, const char *path) {
+    Raster raster;
+    initRaster(&raster, extent, HEATMAP_SIZE, HEATMAP_SIZE);
+    rasterizeTree(&raster, root);
+    int status = writeRasterFrame(&raster, mode, path);
+    freeRaster(&raster);
+    return status;
+}
+
+// Open a sensor text file for streaming; returns -1 if it cannot be opened
+int openSensorReader(SensorReader *reader, const char *path) {
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        return -1;
+    }
+    reader->path = path;
+    reader->capacity = READER_CHUNK_SIZE;
+    reader->buffer = (char *)malloc(reader->capacity);
+    if (!reader->buffer) {
+        fprintf(stderr, "Memory allocation failed for sensor reader.\n");
+        exit(EXIT_FAILURE);
+    }
+    reader->length = 0;
+    reader->position = 0;
+    reader->at_eof = 0;
+    reader->line = 0;
+    reader->errors = 0;
+    return 0;
+}
+
+// Close the reader and release its buffer
+void closeSensorReader(SensorReader *reader) {
+    fclose(reader->file);
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+// Move the unparsed tail to the front of the buffer and read the next chunk behind it
+void refillSensorReader(SensorReader *reader) {
+    size_t tail = reader->length - reader->position;
+    memmove(reader->buffer, reader->buffer + reader->position, tail);
+    reader->length = tail;
+    reader->position = 0;
+
+    // A line longer than the free space grows the buffer
+    if (reader->capacity - reader->length < READER_CHUNK_SIZE / 2) {
+        reader->capacity *= 2;
+        char *grown = (char *)realloc(reader->buffer, reader->capacity);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for sensor reader.\n");
+            exit(EXIT_FAILURE);
+        }
+        reader->buffer = grown;
+    }
+
+    size_t got = fread(reader->buffer + reader->length, 1, reader->capacity - reader->length, reader->file);
+    reader->length += got;
+    if (got == 0) {
+        reader->at_eof = 1;
+    }
+}
+
+// Parse an optionally signed decimal integer at *cursor, skipping leading blanks.
+// Returns 0 if there is no integer there or it does not fit in [min, max].
+int parseIntegerField(const char **cursor, const char *end, long long min, long long max, long long *value) {
+    const char *p = *cursor;
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    const char *digits = p;
+    unsigned long long limit = negative ? 0ULL - (unsigned long long)min : (unsigned long long)max;
+    unsigned long long v = 0;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        unsigned digit = (unsigned)(*p - '0');
+        if (v > (limit - digit) / 10) {
+            return 0;
+        }
+        v = v * 10 + digit;
+        p++;
+    }
+    if (p == digits) {
+        return 0;
+    }
+    *value = negative ? -(long long)(v - 1) - 1 : (long long)v;
+    *cursor = p;
+    return 1;
+}
+
+// Parse a sensor reading (an int) at *cursor
+int parseSensorField(const char **cursor, const char *end, int *value) {
+    long long v;
+    if (!parseIntegerField(cursor, end, INT_MIN, INT_MAX, &v)) {
+        return 0;
+    }
+    *value = (int)v;
+    return 1;
+}
+
+// Parse a coordinate at *cursor. Integer builds check that it fits in coord_t; floating-point
+// builds accept any decimal or exponent notation strtod understands.
+int parseCoordinateField(const char **cursor, const char *end, coord_t *value) {
+#if COORD_IS_INTEGER
+    long long v;
+    if (!parseIntegerField(cursor, end, COORD_MIN, COORD_MAX, &v)) {
+        return 0;
+    }
+    *value = (coord_t)v;
+    return 1;
+#else
+    // The buffer is not NUL-terminated, so copy the token out before handing it to strtod
+    const char *p = *cursor;
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    char token[64];
+    size_t length = 0;
+    while (p + length < end && p[length] != ' ' && p[length] != '\t' && length < sizeof(token) - 1) {
+        token[length] = p[length];
+        length++;
+    }
+    token[length] = '\0';
+    char *parsed;
+    double v = strtod(token, &parsed);
+    if (length == 0 || parsed != token + length || isnan(v)) {
+        return 0;
+    }
+    *value = (coord_t)v;
+    *cursor = p + length;
+    return 1;
+#endif
+}
+
+// Read the next valid row into record. Blank lines are skipped and malformed rows are
+// reported with their line number and skipped. Returns 1 for a record and 0 at end of file.
+int readSensorRecord(SensorReader *reader, SensorNode *record) {
+    while (1) {
+        char *start = reader->buffer + reader->position;
+        char *newline = (char *)memchr(start, '\n', reader->length - reader->position);
+        if (!newline && !reader->at_eof) {
+            refillSensorReader(reader);
+            continue;
+        }
+        if (!newline && reader->position == reader->length) {
+            return 0;
+        }
+
+        // The last line of the file may lack a newline
+        char *end = newline ? newline : reader->buffer + reader->length;
+        reader->position = newline ? (size_t)(newline + 1 - reader->buffer) : reader->length;
+        reader->line++;
+
+        while (end > start && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) {
+            end--;
+        }
+        if (end == start) {
+            continue;
+        }
+
+        const char *p = start;
+        int ok = parseCoordinateField(&p, end, &record->x) && parseCoordinateField(&p, end, &record->y) &&
+                 parseSensorField(&p, end, &record->humidity) && parseSensorField(&p, end, &record->PollutionLevel) &&
+                 parseSensorField(&p, end, &record->temperature) && p == end;
+        if (ok) {
+            return 1;
+        }
+        fprintf(stderr, "Error: %s:%ld: expected x y humidity pollution temperature; row skipped.\n",
+                reader->path, reader->line);
+        reader->errors++;
+    }
+}
+
+// Read a sensor text file and bulk load it into a new tree; returns NULL on failure
+RTree *loadSensorFile(const char *file_path, SplitPolicy policy) {
+    SensorReader reader;
+    if (openSensorReader(&reader, file_path) != 0) {
+        fprintf(stderr, "Error: Could not open initial dataset file %s.\n", file_path);
+        return NULL;
+    }
+
+    // The tree owns every node and sensor through its pools
+    RTree *tree = createRTree(policy);
+
+    // Read the whole dataset first so the tree can be bulk loaded in one pass
+    SensorNode record;
+    int num_sensors = 0, sensor_capacity = 1024;
+    SensorNode **sensors = (SensorNode **)malloc(sensor_capacity * sizeof(SensorNode *));
+    if (!sensors) {
+        fprintf(stderr, "Memory allocation failed for sensor list.\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("Loading data from %s...\n", file_path);
+    while (readSensorRecord(&reader, &record)) {
+        SensorNode *sensor = createSensorNode(tree);
+        *sensor = record;
+
+        if (num_sensors == sensor_capacity) {
+            sensor_capacity *= 2;
+            SensorNode **grown = (SensorNode **)realloc(sensors, sensor_capacity * sizeof(SensorNode *));
+            if (!grown) {
+                fprintf(stderr, "Memory allocation failed for sensor list.\n");
+                exit(EXIT_FAILURE);
+            }
+            sensors = grown;
+        }
+        sensors[num_sensors++] = sensor;
+    }
+    if (reader.errors > 0) {
+        fprintf(stderr, "Skipped %ld malformed rows in %s.\n", reader.errors, file_path);
+    }
+    closeSensorReader(&reader);
+
+    // Build the R-Tree bottom-up from the loaded sensors
+    bulkLoadRTree(tree, sensors, num_sensors);
+    free(sensors);
+    return tree;
+}
+
+// Apply the readings of a sensor text file to the sensors already in the tree.
+// Returns the number of sensors updated, or -1 if the file cannot be opened.
+int updateSensorsFromFile(RTree *tree, const char *file_path) {
+    SensorReader reader;
+    if (openSensorReader(&reader, file_path) != 0) {
+        return -1;
+    }
+
+    SensorNode record;
+    int updated = 0;
+    while (readSensorRecord(&reader, &record)) {
+        // Readings are overwritten in place, found through the coordinate index; the aggregates
+        // on the sensor's path are refreshed with them
+        SensorNode *existing_sensor = findSensorAt(tree, record.x, record.y);
+        if (existing_sensor) {
+            updateSensorReadings(tree, existing_sensor, &record);
+            updated++;
+        }
+    }
+    if (tree->history) {
+        recordHistoryStep(tree);
+    }
+    if (reader.errors > 0) {
+        fprintf(stderr, "Skipped %ld malformed rows in %s.\n", reader.errors, file_path);
+    }
+    closeSensorReader(&reader);
+    return updated;
+}
+
+// Reading of a sensor stored in the given history column
+int sensorReading(SensorNode *sensor, int column) {
+    return column == 0 ? sensor->humidity : column == 1 ? sensor->PollutionLevel : sensor->temperature;
+}
+
+// Append a difference of two readings to a column as a zigzag varint. The difference is taken
+// modulo 2^32, so readings at opposite ends of the int range cannot overflow it.
+void appendVarint(ByteColumn *column, uint32_t delta) {
+    uint32_t zigzag = (delta << 1) ^ (0u - (delta >> 31));
+    if (column->capacity - column->length < 5) {
+        column->capacity = column->capacity ? column->capacity * 2 : 16;
+        unsigned char *grown = (unsigned char *)realloc(column->bytes, column->capacity);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for sensor history.\n");
+            exit(EXIT_FAILURE);
+        }
+        column->bytes = grown;
+    }
+    while (zigzag >= 0x80) {
+        column->bytes[column->length++] = (unsigned char)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    column->bytes[column->length++] = (unsigned char)zigzag;
+}
+
+// Decode the zigzag varint at *position and advance past it; returns the difference modulo 2^32
+uint32_t readVarint(const unsigned char *bytes, uint32_t *position) {
+    uint32_t zigzag = 0;
+    int shift = 0;
+    unsigned char byte;
+    do {
+        byte = bytes[(*position)++];
+        zigzag |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return (zigzag >> 1) ^ (0u - (zigzag & 1));
+}
+
+// Slot of (x, y) in the history's series map
+size_t historySlot(SensorHistory *history, coord_t x, coord_t y) {
+    uint64_t key = coordinateKey(x, y);
+    size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (history->slot_capacity - 1);
+    while (history->slots[slot]) {
+        SensorSeries *series = &history->series[history->slots[slot] - 1];
+        if (series->x == x && series->y == y) {
+            break;
+        }
+        slot = (slot + 1) & (history->slot_capacity - 1);
+    }
+    return slot;
+}
+
+// Series of the sensor at (x, y), or NULL if it has never been recorded
+SensorSeries *findSeries(SensorHistory *history, coord_t x, coord_t y) {
+    int entry = history->slots[historySlot(history, x, y)];
+    return entry ? &history->series[entry - 1] : NULL;
+}
+
+// Series of the sensor at (x, y), created empty if needed
+SensorSeries *findOrAddSeries(SensorHistory *history, coord_t x, coord_t y) {
+    SensorSeries *existing = findSeries(history, x, y);
+    if (existing) {
+        return existing;
+    }
+
+    // Keep the map at most half full
+    if ((size_t)(history->num_series + 1) * 2 > history->slot_capacity) {
+        free(history->slots);
+        history->slot_capacity *= 2;
+        history->slots = (int *)calloc(history->slot_capacity, sizeof(int));
+        if (!history->slots) {
+            fprintf(stderr, "Memory allocation failed for sensor history.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < history->num_series; i++) {
+            history->slots[historySlot(history, history->series[i].x, history->series[i].y)] = i + 1;
+        }
+    }
+    if (history->num_series == history->series_capacity) {
+        history->series_capacity = history->series_capacity ? history->series_capacity * 2 : 1024;
+        SensorSeries *grown = (SensorSeries *)realloc(history->series, history->series_capacity * sizeof(SensorSeries));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for sensor history.\n");
+            exit(EXIT_FAILURE);
+        }
+        history->series = grown;
+    }
+
+    SensorSeries *series = &history->series[history->num_series++];
+    memset(series, 0, sizeof(SensorSeries));
+    series->x = x;
+    series->y = y;
+    history->slots[historySlot(history, x, y)] = history->num_series;
+    return series;
+}
+
+// Append one sample to a series, opening a new bucket every HISTORY_BUCKET_STEPS samples.
+// A gap (present = 0) takes a sample position so that later samples can still be found by
+// timestep, but it repeats the previous values and is left out of the bucket's range.
+void appendSample(SensorSeries *series, int *values, int present) {
+    int in_bucket = series->num_steps % HISTORY_BUCKET_STEPS;
+    int bucket = series->num_steps / HISTORY_BUCKET_STEPS;
+    if (in_bucket == 0) {
+        if (bucket == series->bucket_capacity) {
+            series->bucket_capacity = series->bucket_capacity ? series->bucket_capacity * 2 : 4;
+            HistoryBucket *grown = (HistoryBucket *)realloc(series->buckets, series->bucket_capacity * sizeof(HistoryBucket));
+            if (!grown) {
+                fprintf(stderr, "Memory allocation failed for sensor history.\n");
+                exit(EXIT_FAILURE);
+            }
+            series->buckets = grown;
+        }
+        for (int c = 0; c < HISTORY_COLUMNS; c++) {
+            series->buckets[bucket].offset[c] = series->columns[c].length;
+            series->buckets[bucket].min_value[c] = INT_MAX;
+            series->buckets[bucket].max_value[c] = INT_MIN;
+        }
+        series->buckets[bucket].present = 0;
+    }
+
+    HistoryBucket *summary = &series->buckets[bucket];
+    for (int c = 0; c < HISTORY_COLUMNS; c++) {
+        uint32_t previous = in_bucket == 0 ? 0 : (uint32_t)series->last_value[c];
+        appendVarint(&series->columns[c], (uint32_t)values[c] - previous);
+        series->last_value[c] = values[c];
+        if (present) {
+            summary->min_value[c] = values[c] < summary->min_value[c] ? values[c] : summary->min_value[c];
+            summary->max_value[c] = values[c] > summary->max_value[c] ? values[c] : summary->max_value[c];
+        }
+    }
+    summary->present |= (uint32_t)(present != 0) << in_bucket;
+    series->num_steps++;
+}
+
+// Turn on temporal mode: from now on every dataset load appends a timestep to each sensor's
+// series. The current readings become the first timestep.
+void enableSensorHistory(RTree *tree) {
+    if (tree->history) {
+        return;
+    }
+    SensorHistory *history = (SensorHistory *)calloc(1, sizeof(SensorHistory));
+    if (!history) {
+        fprintf(stderr, "Memory allocation failed for sensor history.\n");
+        exit(EXIT_FAILURE);
+    }
+    history->slot_capacity = 1024;
+    history->slots = (int *)calloc(history->slot_capacity, sizeof(int));
+    if (!history->slots) {
+        fprintf(stderr, "Memory allocation failed for sensor history.\n");
+        exit(EXIT_FAILURE);
+    }
+    tree->history = history;
+    recordHistoryStep(tree);
+}
+
+// Free a history and all of its series
+void destroySensorHistory(SensorHistory *history) {
+    if (!history) {
+        return;
+    }
+    for (int i = 0; i < history->num_series; i++) {
+        for (int c = 0; c < HISTORY_COLUMNS; c++) {
+            free(history->series[i].columns[c].bytes);
+        }
+        free(history->series[i].buckets);
+    }
+    free(history->series);
+    free(history->slots);
+    free(history);
+}
+
+// Append the current readings of every sensor in the tree as the next timestep. A sensor
+// missing from earlier timesteps since its series began (deleted and inserted again) gets a
+// gap for each of them.
+void recordHistoryStep(RTree *tree) {
+    SensorHistory *history = tree->history;
+    int step = history->num_steps++;
+    for (size_t slot = 0; slot < tree->index.capacity; slot++) {
+        SensorNode *sensor = tree->index.slots[slot];
+        if (!sensor) {
+            continue;
+        }
+        SensorSeries *series = findOrAddSeries(history, sensor->x, sensor->y);
+        if (series->num_steps == 0) {
+            series->first_step = step;
+        }
+        while (series->first_step + series->num_steps < step) {
+            appendSample(series, series->last_value, 0);
+        }
+        int values[HISTORY_COLUMNS];
+        for (int c = 0; c < HISTORY_COLUMNS; c++) {
+            values[c] = sensorReading(sensor, c);
+        }
+        appendSample(series, values, 1);
+    }
+}
+
+// Readings of the sensor at (x, y) at a timestep (1 = first dataset). Returns 0 if there is no
+// sample, including for the timesteps the sensor was missing from the tree.
+int sensorHistoryAt(RTree *tree, coord_t x, coord_t y, int step, SensorNode *result) {
+    SensorSeries *series = tree->history ? findSeries(tree->history, x, y) : NULL;
+    int k = step - 1 - (series ? series->first_step : 0);
+    if (!series || k < 0 || k >= series->num_steps) {
+        return 0;
+    }
+    HistoryBucket *bucket = &series->buckets[k / HISTORY_BUCKET_STEPS];
+    if (!(bucket->present & (1u << (k % HISTORY_BUCKET_STEPS)))) {
+        return 0;
+    }
+
+    // Decode from the start of the sample's bucket
+    int values[HISTORY_COLUMNS];
+    for (int c = 0; c < HISTORY_COLUMNS; c++) {
+        uint32_t position = bucket->offset[c];
+        uint32_t value = 0;
+        for (int j = 0; j <= k % HISTORY_BUCKET_STEPS; j++) {
+            value += readVarint(series->columns[c].bytes, &position);
+        }
+        values[c] = (int)value;
+    }
+    result->x = x;
+    result->y = y;
+    result->humidity = values[0];
+    result->PollutionLevel = values[1];
+    result->temperature = values[2];
+    return 1;
+}
+
+// Check whether a series' temperature exceeded threshold at any sample in [first, last]
+// (sample numbers within the series); gaps never count. Buckets whose maximum is at or below
+// the threshold are skipped, and a bucket lying wholly in the interval is answered from its maximum.
+int seriesExceeds(SensorSeries *series, int threshold, int first, int last) {
+    const int column = 2;
+    for (int b = first / HISTORY_BUCKET_STEPS; b <= last / HISTORY_BUCKET_STEPS; b++) {
+        HistoryBucket *bucket = &series->buckets[b];
+        if (bucket->max_value[column] <= threshold) {
+            continue;
+        }
+        int bucket_first = b * HISTORY_BUCKET_STEPS;
+        int bucket_last = bucket_first + HISTORY_BUCKET_STEPS - 1;
+        if (bucket_last >= series->num_steps) {
+            bucket_last = series->num_steps - 1;
+        }
+        if (first <= bucket_first && bucket_last <= last) {
+            return 1;
+        }
+
+        // Partly covered: decode the temperature column of this bucket only
+        uint32_t position = bucket->offset[column];
+        uint32_t value = 0;
+        int end = bucket_last < last ? bucket_last : last;
+        for (int k = bucket_first; k <= end; k++) {
+            value += readVarint(series->columns[column].bytes, &position);
+            if (k >= first && (int)value > threshold && (bucket->present & (1u << (k - bucket_first)))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Sensors in query_box whose temperature exceeded threshold at some timestep in
+// [first_step, last_step] (1 = first dataset). Up to capacity of them are stored in results;
+// the total is returned. Only sensors currently in the tree are considered.
+int historyExceedances(RTree *tree, BoundingBox *query_box, int threshold, int first_step, int last_step,
+                       SensorNode **results, int capacity) {
+    if (!tree->history) {
+        return 0;
+    }
+    SensorNode *batch[QUERY_BATCH_SIZE];
+    QueryCursor cursor;
+    int count = 0, fetched;
+
+    openRangeCursor(&cursor, tree->root, query_box);
+    while ((fetched = fetchRangeResults(&cursor, batch, QUERY_BATCH_SIZE)) > 0) {
+        for (int i = 0; i < fetched; i++) {
+            SensorSeries *series = findSeries(tree->history, batch[i]->x, batch[i]->y);
+            if (!series) {
+                continue;
+            }
+            // Clip the interval to the samples this series holds
+            int first = first_step - 1 - series->first_step;
+            int last = last_step - 1 - series->first_step;
+            first = first < 0 ? 0 : first;
+            last = last >= series->num_steps ? series->num_steps - 1 : last;
+            if (first <= last && seriesExceeds(series, threshold, first, last)) {
+                if (count < capacity) {
+                    results[count] = batch[i];
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Grid cell index of a coordinate (rounding towards negative infinity)
+long long standingCell(StandingQuerySet *set, coord_t value) {
+#if COORD_IS_INTEGER
+    coord_t cell = value / set->cell_size;
+    return value % set->cell_size < 0 ? cell - 1 : cell;
+#else
+    // Clamp so that far-out or infinite coordinates still map to a valid cell
+    double cell = floor((double)value / set->cell_size);
+    return cell < -(double)(1LL << 62) ? -(1LL << 62) : cell > (double)(1LL << 62) ? (1LL << 62) : (long long)cell;
+#endif
+}
+
+// Hash slot of grid cell (cell_x, cell_y); distinct cells may share a slot
+size_t standingSlot(long long cell_x, long long cell_y) {
+    uint64_t key = ((uint64_t)(uint32_t)cell_x << 32) | (uint32_t)cell_y;
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (STANDING_GRID_SLOTS - 1);
+}
+
+// Append a query id to a list unless it was the last one added
+void addToQueryList(QueryList *list, int id) {
+    if (list->count > 0 && list->ids[list->count - 1] == id) {
+        return;
+    }
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 4;
+        int *grown = (int *)realloc(list->ids, list->capacity * sizeof(int));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for standing queries.\n");
+            exit(EXIT_FAILURE);
+        }
+        list->ids = grown;
+    }
+    list->ids[list->count++] = id;
+}
+
+// Attach an empty set of standing queries to a tree; cell_size sets the grid used to find the
+// queries affected by a change (roughly the size of a typical watched zone works well)
+void enableStandingQueries(RTree *tree, coord_t cell_size) {
+    if (tree->standing) {
+        return;
+    }
+    StandingQuerySet *set = (StandingQuerySet *)calloc(1, sizeof(StandingQuerySet));
+    if (!set) {
+        fprintf(stderr, "Memory allocation failed for standing queries.\n");
+        exit(EXIT_FAILURE);
+    }
+    set->cell_size = cell_size > 0 ? cell_size : STANDING_CELL_SIZE;
+    tree->standing = set;
+}
+
+// Free a set of standing queries and any events not yet fetched
+void destroyStandingQueries(StandingQuerySet *set) {
+    if (!set) {
+        return;
+    }
+    for (int i = 0; i < STANDING_GRID_SLOTS; i++) {
+        free(set->cells[i].ids);
+    }
+    free(set->oversized.ids);
+    free(set->queries);
+    free(set->events);
+    free(set);
+}
+
+// Register a standing query over region, optionally watching a temperature threshold.
+// From now on changes inside the region produce events. Returns the query id.
+int addStandingQuery(RTree *tree, BoundingBox *region, int has_threshold, int threshold) {
+    enableStandingQueries(tree, STANDING_CELL_SIZE);
+    StandingQuerySet *set = tree->standing;
+    if (set->num_queries == set->query_capacity) {
+        set->query_capacity = set->query_capacity ? set->query_capacity * 2 : 64;
+        StandingQuery *grown = (StandingQuery *)realloc(set->queries, set->query_capacity * sizeof(StandingQuery));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for standing queries.\n");
+            exit(EXIT_FAILURE);
+        }
+        set->queries = grown;
+    }
+    int id = set->num_queries++;
+    set->queries[id].region = *region;
+    set->queries[id].has_threshold = has_threshold;
+    set->queries[id].threshold = threshold;
+    set->queries[id].active = 1;
+
+    long long first_x = standingCell(set, region->min_x), last_x = standingCell(set, region->max_x);
+    long long first_y = standingCell(set, region->min_y), last_y = standingCell(set, region->max_y);
+    double cells = ((double)last_x - first_x + 1) * ((double)last_y - first_y + 1);
+    if (cells > STANDING_MAX_CELLS) {
+        addToQueryList(&set->oversized, id);
+        return id;
+    }
+    for (long long cell_x = first_x; cell_x <= last_x; cell_x++) {
+        for (long long cell_y = first_y; cell_y <= last_y; cell_y++) {
+            addToQueryList(&set->cells[standingSlot(cell_x, cell_y)], id);
+        }
+    }
+    return id;
+}
+
+// Stop a standing query; its id is not reused. Returns 0 if there was no active query with that id.
+int removeStandingQuery(RTree *tree, int query_id) {
+    if (!tree->standing || query_id < 0 || query_id >= tree->standing->num_queries ||
+        !tree->standing->queries[query_id].active) {
+        return 0;
+    }
+    tree->standing->queries[query_id].active = 0;
+    return 1;
+}
+
+// Queue one event
+void pushStandingEvent(StandingQuerySet *set, int query_id, StandingEventType type, SensorNode *sensor) {
+    if (set->num_events == set->event_capacity) {
+        set->event_capacity = set->event_capacity ? set->event_capacity * 2 : 64;
+        StandingEvent *grown = (StandingEvent *)realloc(set->events, set->event_capacity * sizeof(StandingEvent));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for standing query events.\n");
+            exit(EXIT_FAILURE);
+        }
+        set->events = grown;
+    }
+    set->events[set->num_events].query_id = query_id;
+    set->events[set->num_events].type = type;
+    set->events[set->num_events].sensor = *sensor;
+    set->num_events++;
+}
+
+// Report a change to the standing queries whose region contains the sensor. Only the queries
+// bucketed in the sensor's grid cell (and the oversized ones) are looked at.
+void notifyStandingQueries(StandingQuerySet *set, SensorNode *sensor, SensorChange change, int old_temperature) {
+    QueryList *lists[2] = {&set->cells[standingSlot(standingCell(set, sensor->x), standingCell(set, sensor->y))],
+                           &set->oversized};
+    for (int l = 0; l < 2; l++) {
+        for (int i = 0; i < lists[l]->count; i++) {
+            int id = lists[l]->ids[i];
+            StandingQuery *query = &set->queries[id];
+            if (!query->active || sensor->x < query->region.min_x || sensor->x > query->region.max_x ||
+                sensor->y < query->region.min_y || sensor->y > query->region.max_y) {
+                continue;
+            }
+            if (change == SENSOR_ADDED) {
+                pushStandingEvent(set, id, STANDING_ENTER, sensor);
+            } else if (change == SENSOR_REMOVED) {
+                pushStandingEvent(set, id, STANDING_EXIT, sensor);
+            } else if (query->has_threshold) {
+                int was_above = old_temperature >= query->threshold;
+                int is_above = sensor->temperature >= query->threshold;
+                if (was_above != is_above) {
+                    pushStandingEvent(set, id, is_above ? STANDING_ABOVE : STANDING_BELOW, sensor);
+                }
+            }
+        }
+    }
+}
+
+// Move up to capacity pending events, oldest first, into events; returns how many were moved
+int fetchStandingEvents(RTree *tree, StandingEvent *events, int capacity) {
+    StandingQuerySet *set = tree->standing;
+    if (!set || set->num_events == 0) {
+        return 0;
+    }
+    int count = set->num_events < capacity ? set->num_events : capacity;
+    memcpy(events, set->events, count * sizeof(StandingEvent));
+    memmove(set->events, set->events + count, (set->num_events - count) * sizeof(StandingEvent));
+    set->num_events -= count;
+    return count;
+}
+
+// Name of a benchmark distribution
+const char *distributionName(SensorDistribution distribution) {
+    switch (distribution) {
+    case DIST_UNIFORM:
+        return "uniform";
+    case DIST_CLUSTERED:
+        return "clustered";
+    default:
+        return "fire";
+    }
+}
+
+// Parse a benchmark distribution name; returns 0 if it is not recognised
+int parseDistribution(const char *name, SensorDistribution *distribution) {
+    if (strcmp(name, "uniform") == 0) {
+        *distribution = DIST_UNIFORM;
+    } else if (strcmp(name, "clustered") == 0) {
+        *distribution = DIST_CLUSTERED;
+    } else if (strcmp(name, "fire") == 0) {
+        *distribution = DIST_FIRE;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Parse a positive --sensors or --operations count; returns 0 if it is not a number
+// from 1 to BENCH_MAX_RECORDS
+int parseBenchCount(const char *text, int *count) {
+    char *end;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || value < 1 || value > BENCH_MAX_RECORDS) {
+        return 0;
+    }
+    *count = (int)value;
+    return 1;
+}
+
+// Next value of the benchmark's random stream (SplitMix64). Unlike rand() it yields
+// the same sequence on every platform, so a seed reproduces a run exactly.
+uint64_t benchRandom(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
 }
 
-// Calculate the area of a bounding box
-int area(BoundingBox *bbox) {
-    return (bbox->max_x - bbox->min_x) * (bbox->max_y - bbox->min_y);
+// Uniform double in [0, 1)
+double benchUniform(uint64_t *state) {
+    return (benchRandom(state) >> 11) * (1.0 / 9007199254740992.0);
 }
 
-// Check if two bounding boxes overlap
-int overlaps(BoundingBox *a, BoundingBox *b) {
-    return !(a->min_x > b->max_x || a->max_x < b->min_x || a->min_y > b->max_y || a->max_y < b->min_y);
+// Standard normal deviate (Box-Muller)
+double benchGaussian(uint64_t *state) {
+    double u = 1.0 - benchUniform(state);
+    const double PI = 3.14159265358979323846;
+    return sqrt(-2.0 * log(u)) * cos(2.0 * PI * benchUniform(state));
 }
 
-// Expand bounding box 'a' to include bounding box 'b'
-void expandToInclude(BoundingBox *a, BoundingBox *b) {
-    a->min_x = a->min_x < b->min_x ? a->min_x : b->min_x;
-    a->min_y = a->min_y < b->min_y ? a->min_y : b->min_y;
-    a->max_x = a->max_x > b->max_x ? a->max_x : b->max_x;
-    a->max_y = a->max_y > b->max_y ? a->max_y : b->max_y;
+// Side of the square field holding count sensors at the density of the bundled datasets
+double benchFieldSide(int count) {
+    return BENCH_SENSOR_SPACING * sqrt(count > 1 ? (double)count : 1.0);
 }
 
-// Update the bounding box of a node to cover all its children/sensors
-void updateBoundingBox(RTreeNode *node) {
-    if (node->num_entries == 0) {
-        node->bbox = (BoundingBox){INT_MAX, INT_MAX, INT_MIN, INT_MIN};
+// Readings of a sensor at timestep step. Fire data mirrors sensors/: a hot, dry front spreads
+// outwards from the centre of the field and reaches its edge after BENCH_FIRE_STEPS steps.
+void benchReadings(SensorNode *sensor, SensorDistribution distribution, double side, int step, uint64_t *state) {
+    sensor->PollutionLevel = (int)(benchUniform(state) * 300);
+    if (distribution != DIST_FIRE) {
+        sensor->humidity = (int)(benchUniform(state) * 100);
+        sensor->temperature = 30 + (int)(benchUniform(state) * 30);
         return;
     }
+    double dx = (double)sensor->x - side / 2, dy = (double)sensor->y - side / 2;
+    double front = side / 2 * (step + 1) / BENCH_FIRE_STEPS;
+    if (sqrt(dx * dx + dy * dy) <= front) {
+        sensor->humidity = (int)(benchUniform(state) * 30);
+        sensor->temperature = 70 + (int)(benchUniform(state) * 30);
+    } else {
+        sensor->humidity = 40 + (int)(benchUniform(state) * 60);
+        sensor->temperature = 30 + (int)(benchUniform(state) * 25);
+    }
+}
 
-    node->bbox = node->is_leaf ? createBoundingBoxForSensor(node->sensors[0]) : node->children[0]->bbox;
-    for (int i = 1; i < node->num_entries; i++) {
-        if (node->is_leaf) {
-            BoundingBox sensor_bbox = createBoundingBoxForSensor(node->sensors[i]);
-            expandToInclude(&node->bbox, &sensor_bbox);
-        } else {
-            expandToInclude(&node->bbox, &node->children[i]->bbox);
-        }
+// Fill records with count sensors at distinct positions drawn from the distribution
+void generateSensors(SensorNode *records, int count, SensorDistribution distribution, uint64_t *state) {
+    double side = benchFieldSide(count);
+    double centres[BENCH_CLUSTERS][2];
+    for (int c = 0; c < BENCH_CLUSTERS; c++) {
+        centres[c][0] = benchUniform(state) * side;
+        centres[c][1] = benchUniform(state) * side;
+    }
+    double spread = side / (4 * sqrt((double)BENCH_CLUSTERS));
+
+    // Positions are drawn again until they are free, since the index keys sensors by position
+    SensorIndex seen;
+    initSensorIndex(&seen);
+    for (int i = 0; i < count; i++) {
+        SensorNode *sensor = &records[i];
+        do {
+            double x, y;
+            if (distribution == DIST_CLUSTERED) {
+                int c = (int)(benchRandom(state) % BENCH_CLUSTERS);
+                x = centres[c][0] + benchGaussian(state) * spread;
+                y = centres[c][1] + benchGaussian(state) * spread;
+                x = x < 0 ? 0 : x > side ? side : x;
+                y = y < 0 ? 0 : y > side ? side : y;
+            } else {
+                x = benchUniform(state) * side;
+                y = benchUniform(state) * side;
+            }
+            sensor->x = (coord_t)x;
+            sensor->y = (coord_t)y;
+        } while (sensorIndexFind(&seen, sensor->x, sensor->y));
+        sensorIndexInsert(&seen, sensor);
+        benchReadings(sensor, distribution, benchFieldSide(count), 0, state);
     }
+    destroySensorIndex(&seen);
 }
 
-// Insert a sensor into the R-tree and handle splitting if necessary
-void insertSensorIntoRTree(RTreeNode *root, SensorNode *sensor) {
-    if (!sensor) {
-        fprintf(stderr, "Error: Attempting to insert a NULL sensor.\n");
-        return;
+// Monotonic clock in seconds
+double monotonicSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Start an empty workload with room for the given number of operations
+void startWorkload(BenchWorkload *workload, const char *name, int capacity) {
+    workload->name = name;
+    workload->count = 0;
+    workload->capacity = capacity > 0 ? capacity : 1;
+    workload->latencies = (double *)malloc(workload->capacity * sizeof(double));
+    if (!workload->latencies) {
+        fprintf(stderr, "Memory allocation failed for benchmark latencies.\n");
+        exit(EXIT_FAILURE);
     }
+    workload->results = 0;
+#ifdef RTREE_STATS
+    resetRTreeCounters();
+#endif
+    workload->seconds = monotonicSeconds();
+}
 
-    RTreeNode *node = root;
+// Record the latency of one operation
+void recordLatency(BenchWorkload *workload, double seconds) {
+    if (workload->count < workload->capacity) {
+        workload->latencies[workload->count++] = seconds;
+    }
+}
 
-    // Traverse the tree to find the appropriate leaf node
-    while (!node->is_leaf) {
-        RTreeNode *best_child = node->children[0];
-        int min_enlargement = INT_MAX;
+int compareDoubles(const void *a, const void *b) {
+    double da = *(const double *)a, db = *(const double *)b;
+    return (da > db) - (da < db);
+}
 
-        for (int i = 0; i < node->num_entries; i++) {
-            BoundingBox expanded_bbox = node->children[i]->bbox;
-            BoundingBox sensor_bbox = createBoundingBoxForSensor(sensor);
-            expandToInclude(&expanded_bbox, &sensor_bbox);
-            int enlargement = area(&expanded_bbox) - area(&node->children[i]->bbox);
+// Stop the workload clock and print its summary as one JSON object
+void finishWorkload(BenchWorkload *workload, int first) {
+    workload->seconds = monotonicSeconds() - workload->seconds;
+    qsort(workload->latencies, workload->count, sizeof(double), compareDoubles);
+    double p50 = workload->count ? workload->latencies[(long long)(workload->count - 1) * 50 / 100] : 0;
+    double p99 = workload->count ? workload->latencies[(long long)(workload->count - 1) * 99 / 100] : 0;
+    printf("%s    {\"name\": \"%s\", \"operations\": %d, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+           "\"p50_us\": %.3f, \"p99_us\": %.3f, \"results\": %lld",
+           first ? "" : ",\n", workload->name, workload->count, workload->seconds,
+           workload->seconds > 0 ? workload->count / workload->seconds : 0.0, p50 * 1e6, p99 * 1e6, workload->results);
+#ifdef RTREE_STATS
+    RTreeCounters c;
+    getRTreeCounters(&c);
+    printf(", \"counters\": {\"node_visits\": %llu, \"entries_scanned\": %llu, \"false_positives\": %llu, "
+           "\"splits\": %llu, \"reinserts\": %llu, \"merges\": %llu, \"pool_allocs\": %llu, \"pool_releases\": %llu, "
+           "\"slab_allocs\": %llu}",
+           c.node_visits, c.entries_scanned, c.false_positives, c.splits, c.reinserts, c.merges, c.pool_allocs,
+           c.pool_releases, c.slab_allocs);
+#endif
+    printf("}");
+    free(workload->latencies);
+    workload->latencies = NULL;
+}
 
-            if (enlargement < min_enlargement) {
-                min_enlargement = enlargement;
-                best_child = node->children[i];
-            }
-        }
+// Run the benchmark described by config and print the results as JSON on stdout: bulk load,
+// range, radius and nearest-neighbour queries, timestep updates, inserts and deletes
+int runBenchmark(BenchConfig *config) {
+    int n = config->num_sensors, ops = config->num_operations;
+    uint64_t state = config->seed;
+    double side = benchFieldSide(n);
 
-        node = best_child;
+    // The extra records past n are the sensors the insert workload adds
+    SensorNode *records = (SensorNode *)malloc((size_t)(n + ops) * sizeof(SensorNode));
+    if (!records) {
+        fprintf(stderr, "Memory allocation failed for benchmark dataset.\n");
+        exit(EXIT_FAILURE);
     }
+    generateSensors(records, n + ops, config->distribution, &state);
 
-    
-    if (!node->sensors) {
-        fprintf(stderr, "Error: Sensor array is NULL in the leaf node.\n");
-        return;
+    printf("{\n  \"config\": {\"sensors\": %d, \"operations\": %d, \"distribution\": \"%s\", \"split_policy\": \"%s\", "
+           "\"seed\": %llu, \"max_entries\": %d, \"coord_type\": \"%s\"},\n  \"workloads\": [\n",
+           n, ops, distributionName(config->distribution), splitPolicyName(config->policy),
+           (unsigned long long)config->seed, MAX_ENTRIES, COORD_NAME);
+
+    BenchWorkload workload;
+    RTree *tree = createRTree(config->policy);
+    SensorNode **sensors = (SensorNode **)malloc((n > 0 ? n : 1) * sizeof(SensorNode *));
+    if (!sensors) {
+        fprintf(stderr, "Memory allocation failed for sensor list.\n");
+        exit(EXIT_FAILURE);
+    }
+    startWorkload(&workload, "bulk_load", 1);
+    for (int i = 0; i < n; i++) {
+        sensors[i] = createSensorNode(tree);
+        *sensors[i] = records[i];
     }
+    bulkLoadRTree(tree, sensors, n);
+    recordLatency(&workload, monotonicSeconds() - workload.seconds);
+    workload.results = n;
+    finishWorkload(&workload, 1);
+    free(sensors);
 
-    // Insert sensor into the leaf node if it does not already exist
-    node->sensors[node->num_entries] = sensor;
-    node->num_entries++;
-    updateBoundingBox(node);
+    // Queries are centred on sensors so that they follow the data; boxes are sized to hold
+    // about BENCH_QUERY_HITS sensors on uniform data
+    coord_t half = (coord_t)(side * sqrt((double)BENCH_QUERY_HITS / (n > 0 ? n : 1)) / 2);
+    SensorNode *batch[QUERY_BATCH_SIZE];
+    QueryCursor cursor;
+    for (int kind = 0; kind < 2 && n > 0; kind++) {
+        startWorkload(&workload, kind == 0 ? "range" : "radius", ops);
+        for (int q = 0; q < ops; q++) {
+            SensorNode *centre = &records[benchRandom(&state) % n];
+            double start = monotonicSeconds();
+            if (kind == 0) {
+                BoundingBox box = {centre->x - half, centre->y - half, centre->x + half, centre->y + half};
+                openRangeCursor(&cursor, tree->root, &box);
+            } else {
+                openRadiusCursor(&cursor, tree->root, centre->x, centre->y, half, NULL);
+            }
+            int fetched;
+            while ((fetched = fetchRangeResults(&cursor, batch, QUERY_BATCH_SIZE)) > 0) {
+                workload.results += fetched;
+            }
+            recordLatency(&workload, monotonicSeconds() - start);
+        }
+        finishWorkload(&workload, 0);
+    }
 
-    // Handle splitting if the leaf node is full
-    if (node->num_entries > MAX_ENTRIES) {
-        splitNode(node);
+    NeighborResult neighbors[BENCH_NEIGHBORS];
+    startWorkload(&workload, "knn", ops);
+    for (int q = 0; q < ops && n > 0; q++) {
+        SensorNode *centre = &records[benchRandom(&state) % n];
+        double start = monotonicSeconds();
+        workload.results += nearestNeighbors(tree->root, centre->x, centre->y, BENCH_NEIGHBORS, -1, NULL, neighbors);
+        recordLatency(&workload, monotonicSeconds() - start);
     }
-}
+    finishWorkload(&workload, 0);
 
-//Greene's Split Algorithm for node splitting
-void splitNode(RTreeNode *node) {
-    // Step 1: Select two seeds (most distant entries)
-    int seed1 = 0, seed2 = 1;
-    int max_distance = 0;
-    for (int i = 0; i < node->num_entries; i++) {
-        for (int j = i + 1; j < node->num_entries; j++) {
-            int distance = abs(node->sensors[i]->x - node->sensors[j]->x) +
-                           abs(node->sensors[i]->y - node->sensors[j]->y);
-            if (distance > max_distance) {
-                max_distance = distance;
-                seed1 = i;
-                seed2 = j;
+    // Each timestep rewrites the readings of every sensor, as loading the next dataset does
+    startWorkload(&workload, "update", n * BENCH_FIRE_STEPS);
+    for (int step = 1; step <= BENCH_FIRE_STEPS; step++) {
+        for (int i = 0; i < n; i++) {
+            SensorNode record = records[i];
+            benchReadings(&record, config->distribution, side, step, &state);
+            double start = monotonicSeconds();
+            SensorNode *sensor = findSensorAt(tree, record.x, record.y);
+            if (sensor) {
+                updateSensorReadings(tree, sensor, &record);
+                workload.results++;
             }
+            recordLatency(&workload, monotonicSeconds() - start);
         }
     }
-    // Step 2: Create two new nodes and assign seeds
-    RTreeNode *node1 = createRTreeNode(node->is_leaf);
-    RTreeNode *node2 = createRTreeNode(node->is_leaf);
-    node1->sensors[node1->num_entries++] = node->sensors[seed1];
-    node2->sensors[node2->num_entries++] = node->sensors[seed2];
+    finishWorkload(&workload, 0);
 
-    // Step 3: Distribute the remaining entries
-    for (int i = 0; i < node->num_entries; i++) {
-        if (i == seed1 || i == seed2) continue;
-        BoundingBox bbox1 = node1->bbox, bbox2 = node2->bbox;
-        BoundingBox sensor_bbox = createBoundingBoxForSensor(node->sensors[i]);
+    startWorkload(&workload, "insert", ops);
+    for (int i = 0; i < ops; i++) {
+        double start = monotonicSeconds();
+        insertOrUpdateSensor(tree, &records[n + i]);
+        recordLatency(&workload, monotonicSeconds() - start);
+    }
+    workload.results = (long long)tree->index.count;
+    finishWorkload(&workload, 0);
+
+    // Delete distinct sensors, picked with a partial Fisher-Yates shuffle
+    int total = n + ops;
+    int deletes = ops < total ? ops : total;
+    startWorkload(&workload, "delete", deletes);
+    for (int i = 0; i < deletes; i++) {
+        int j = i + (int)(benchRandom(&state) % (uint64_t)(total - i));
+        SensorNode victim = records[j];
+        records[j] = records[i];
+        records[i] = victim;
+        double start = monotonicSeconds();
+        workload.results += deleteSensorFromRTree(tree, &victim);
+        recordLatency(&workload, monotonicSeconds() - start);
+    }
+    finishWorkload(&workload, 0);
 
-        expandToInclude(&bbox1, &sensor_bbox);
-        expandToInclude(&bbox2, &sensor_bbox);
+    int problems = validateRTree(tree);
+    printf("\n  ],\n  \"tree\": {\"sensors\": %zu, \"height\": %d, \"valid\": %s}\n}\n", tree->index.count,
+           treeHeight(tree->root), problems == 0 ? "true" : "false");
 
-        int enlargement1 = area(&bbox1) - area(&node1->bbox);
-        int enlargement2 = area(&bbox2) - area(&node2->bbox);
+    destroyRTree(tree);
+    free(records);
+    return problems == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 
-        if (enlargement1 < enlargement2) {
-            node1->sensors[node1->num_entries++] = node->sensors[i];
-            node1->bbox = bbox1;
-        } else {
-            node2->sensors[node2->num_entries++] = node->sensors[i];
-            node2->bbox = bbox2;
+// Grow a client's response buffer to hold at least extra more bytes
+void reserveResponse(ServerConnection *conn, size_t extra) {
+    if (conn->output_length + extra <= conn->output_capacity) {
+        return;
+    }
+    size_t capacity = conn->output_capacity ? conn->output_capacity : SERVER_FLUSH_BYTES;
+    while (capacity < conn->output_length + extra) {
+        capacity *= 2;
+    }
+    char *grown = (char *)realloc(conn->output, capacity);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed for server responses.\n");
+        exit(EXIT_FAILURE);
+    }
+    conn->output = grown;
+    conn->output_capacity = capacity;
+}
+
+// Write every buffered response to the client. A client that has gone away is marked closed.
+void flushResponses(ServerConnection *conn) {
+    size_t written = 0;
+    while (written < conn->output_length && !conn->closed) {
+        ssize_t n = write(conn->out_fd, conn->output + written, conn->output_length - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "Error: Could not write server response: %s.\n", strerror(errno));
+            conn->closed = 1;
+            break;
         }
+        written += (size_t)n;
     }
+    conn->output_length = 0;
+}
 
-    // Step 4: Update parent or create a new root if necessary
-    if (node->parent) {
-        RTreeNode *parent = node->parent;
-        parent->children[parent->num_entries++] = node1;
-        parent->children[parent->num_entries++] = node2;
-        updateBoundingBox(parent);
-    } else {
-        RTreeNode *new_root = createRTreeNode(0);
-        new_root->children[0] = node1;
-        new_root->children[1] = node2;
-        new_root->num_entries = 2;
-        node1->parent = new_root;
-        node2->parent = new_root;
+// Append formatted text to the client's responses. Responses are only written once the buffer
+// passes SERVER_FLUSH_BYTES or every pending request has been answered, and never inside a
+// read section, where a slow client would hold up every writer.
+void appendResponse(ServerConnection *conn, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(conn->output + conn->output_length, conn->output_capacity - conn->output_length,
+                           format, args);
+    va_end(args);
+    if ((size_t)length >= conn->output_capacity - conn->output_length) {
+        reserveResponse(conn, (size_t)length + 1);
+        va_start(args, format);
+        vsnprintf(conn->output + conn->output_length, conn->output_capacity - conn->output_length, format, args);
+        va_end(args);
+    }
+    conn->output_length += (size_t)length;
+    if (conn->output_length >= SERVER_FLUSH_BYTES && !conn->reading) {
+        flushResponses(conn);
     }
 }
 
-// Print sensor data during range queries
-void printSensor(SensorNode *sensor) {
-    printf("Sensor at (%d, %d): Humidity = %d, Pollution Level = %d, Temperature = %d\n",
-           sensor->x, sensor->y, sensor->humidity, sensor->PollutionLevel, sensor->temperature);
+// Append one sensor as a response row, in the layout of the sensor files
+void appendSensorRow(ServerConnection *conn, SensorNode *sensor) {
+    appendResponse(conn, COORD_FORMAT " " COORD_FORMAT " %d %d %d\n", sensor->x, sensor->y, sensor->humidity,
+                   sensor->PollutionLevel, sensor->temperature);
 }
-// Perform a range query to find sensors that overlap with the query box
-void rangeQuery(RTreeNode *node, BoundingBox *query_box, void (*callback)(SensorNode *), int *count) {
-    if (!overlaps(&node->bbox, query_box)) {
-        return;  // Skip nodes that don't overlap
-    }
 
-    if (node->is_leaf) {
-        for (int i = 0; i < node->num_entries; i++) {
-            BoundingBox sensor_bbox = createBoundingBoxForSensor(node->sensors[i]);
-            if (overlaps(&sensor_bbox, query_box)) {
-                callback(node->sensors[i]);
-                (*count)++;  // Increment the count for each sensor found
-            }
-        }
-    } else {
-        for (int i = 0; i < node->num_entries; i++) {
-            rangeQuery(node->children[i], query_box, callback, count);
+// Parse the coordinate arguments of a request; fails unless exactly count were given
+int parseRequestCoordinates(const char *p, const char *end, coord_t *values, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!parseCoordinateField(&p, end, &values[i])) {
+            return 0;
         }
     }
+    return p == end;
 }
 
-// Helper function to find a sibling node
-RTreeNode* findSibling(RTreeNode *node) {
-    if (!node->parent) return NULL;
-    for (int i = 0; i < node->parent->num_entries; i++) {
-        if (node->parent->children[i] != node) {
-            return node->parent->children[i];
-        }
+// Copy the single file name argument of a request into path; fails if it is missing or too long
+int parseRequestPath(const char *p, const char *end, char *path, size_t size) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
     }
-    return NULL;
+    if (p == end || (size_t)(end - p) >= size) {
+        return 0;
+    }
+    memcpy(path, p, (size_t)(end - p));
+    path[end - p] = '\0';
+    return 1;
 }
 
-// Updated delete function with underflow handling
-void deleteSensorFromRTree(RTreeNode *node, SensorNode *sensor) {
-    if (node->is_leaf) {
-        // Find and remove the sensor in the leaf node
-        int found = 0;
-        for (int i = 0; i < node->num_entries; i++) {
-            if (node->sensors[i]->x == sensor->x && node->sensors[i]->y == sensor->y) {
-                found = 1;
-                // Free the sensor node if dynamically allocated
-                free(node->sensors[i]);
-                // Shift sensors to fill the gap
-                for (int j = i; j < node->num_entries - 1; j++) {
-                    node->sensors[j] = node->sensors[j + 1];
-                }
-                node->num_entries--;
-                break;
+// Read every valid row of a sensor file; returns NULL if it cannot be opened
+SensorNode *readSensorRows(const char *path, int *count) {
+    SensorReader reader;
+    if (openSensorReader(&reader, path) != 0) {
+        return NULL;
+    }
+    int capacity = 1024;
+    SensorNode *rows = (SensorNode *)malloc(capacity * sizeof(SensorNode));
+    if (!rows) {
+        fprintf(stderr, "Memory allocation failed for sensor rows.\n");
+        exit(EXIT_FAILURE);
+    }
+    *count = 0;
+    while (readSensorRecord(&reader, &rows[*count])) {
+        if (++*count == capacity) {
+            capacity *= 2;
+            SensorNode *grown = (SensorNode *)realloc(rows, capacity * sizeof(SensorNode));
+            if (!grown) {
+                fprintf(stderr, "Memory allocation failed for sensor rows.\n");
+                exit(EXIT_FAILURE);
             }
+            rows = grown;
         }
+    }
+    if (reader.errors > 0) {
+        fprintf(stderr, "Skipped %ld malformed rows in %s.\n", reader.errors, path);
+    }
+    closeSensorReader(&reader);
+    return rows;
+}
 
-        if (!found) {
-            printf("Sensor not found in the tree.\n");
-            return;
+// Write requests of the server, applied to each instance by applyConcurrentWrite
+void serverInsertOp(RTree *tree, void *arg) {
+    ServerWrite *write = (ServerWrite *)arg;
+    write->count = insertOrUpdateSensor(tree, &write->record);
+}
+
+void serverDeleteOp(RTree *tree, void *arg) {
+    ServerWrite *write = (ServerWrite *)arg;
+    SensorNode *sensor = findSensorAt(tree, write->record.x, write->record.y);
+    write->count = sensor ? deleteSensorFromRTree(tree, sensor) : 0;
+}
+
+// Overwrite the readings of the sensors already in the tree, as updateSensorsFromFile does
+void serverUpdateOp(RTree *tree, void *arg) {
+    ServerWrite *write = (ServerWrite *)arg;
+    write->count = 0;
+    for (int i = 0; i < write->num_records; i++) {
+        SensorNode *existing_sensor = findSensorAt(tree, write->records[i].x, write->records[i].y);
+        if (existing_sensor) {
+            updateSensorReadings(tree, existing_sensor, &write->records[i]);
+            write->count++;
         }
+    }
+}
 
-        // Update the bounding box after deletion
-        updateBoundingBox(node);
+// Replace the instance with its copy of the snapshot. The contents are swapped so the instance
+// keeps its address in the ConcurrentRTree, and the old contents are freed with the copy.
+void serverLoadOp(RTree *tree, void *arg) {
+    ServerWrite *write = (ServerWrite *)arg;
+    RTree *loaded = write->loaded[write->applied++];
+    RTree old = *tree;
+    *tree = *loaded;
+    *loaded = old;
+    destroyRTree(loaded);
+    write->count = (int)tree->index.count;
+}
 
-        // Check for underflow
-        if (node->num_entries < MIN_ENTRIES && node->parent != NULL) {
-            // Attempt to borrow from siblings
-            RTreeNode *sibling = findSibling(node);
-            if (sibling && sibling->num_entries > MIN_ENTRIES) {
-                // Borrow a sensor from the sibling
-                node->sensors[node->num_entries++] = sibling->sensors[sibling->num_entries - 1];
-                sibling->num_entries--;
-                updateBoundingBox(node);
-                updateBoundingBox(sibling);
-            } else if (sibling) {
-                // Merge with sibling
-                for (int i = 0; i < sibling->num_entries; i++) {
-                    node->sensors[node->num_entries++] = sibling->sensors[i];
-                }
-                node->parent->num_entries--;
-                // Remove sibling from parent
-                for (int i = 0; i < node->parent->num_entries; i++) {
-                    if (node->parent->children[i] == sibling) {
-                        for (int j = i; j < node->parent->num_entries; j++) {
-                            node->parent->children[j] = node->parent->children[j + 1];
-                        }
-                        break;
-                    }
-                }
-                free(sibling);
-                updateBoundingBox(node->parent);
+// Run one request line against the tree and append its response: the result rows, then a
+// status line "OK n" or "ERR message". Queries run inside a read section, so clients on other
+// threads query in parallel; INSERT, DELETE, UPDATE and LOAD go through applyConcurrentWrite.
+ServerAction handleServerRequest(ConcurrentRTree *ctree, ServerConnection *conn, const char *start, const char *end) {
+    const char *args = start;
+    while (args < end && *args != ' ' && *args != '\t') {
+        args++;
+    }
+    size_t length = (size_t)(args - start);
+    coord_t v[4];
+    SensorNode *batch[QUERY_BATCH_SIZE];
+    QueryCursor cursor;
+    ReadTicket ticket;
+    ServerWrite write = {{0, 0, 0, 0, 0, NULL}, NULL, 0, {NULL, NULL}, 0, 0};
+    char path[256];
+    int count = 0, fetched;
+
+#define IS_REQUEST(name) (length == sizeof(name) - 1 && memcmp(start, name, length) == 0)
+    if (IS_REQUEST("RANGE") || IS_REQUEST("RADIUS")) {
+        int is_range = IS_REQUEST("RANGE");
+        if (!parseRequestCoordinates(args, end, v, is_range ? 4 : 3)) {
+            appendResponse(conn, is_range ? "ERR usage: RANGE min_x min_y max_x max_y\n" : "ERR usage: RADIUS x y r\n");
+            return SERVER_CONTINUE;
+        }
+        RTree *tree = beginConcurrentRead(ctree, &ticket);
+        conn->reading = 1;
+        if (is_range) {
+            BoundingBox box = {v[0], v[1], v[2], v[3]};
+            openRangeCursor(&cursor, tree->root, &box);
+        } else {
+            openRadiusCursor(&cursor, tree->root, v[0], v[1], v[2], NULL);
+        }
+        while ((fetched = fetchRangeResults(&cursor, batch, QUERY_BATCH_SIZE)) > 0) {
+            for (int i = 0; i < fetched; i++) {
+                appendSensorRow(conn, batch[i]);
             }
+            count += fetched;
         }
-    } else {
-        // Traverse internal nodes to find the sensor in leaf nodes
-        for (int i = 0; i < node->num_entries; i++) {
-            BoundingBox sensor_bbox = createBoundingBoxForSensor(sensor);
-            if (overlaps(&node->children[i]->bbox, &sensor_bbox)) {
-                deleteSensorFromRTree(node->children[i], sensor);
-
-                // After deletion, check if the child has underflowed
-                RTreeNode *child = node->children[i];
-                if (child->num_entries < MIN_ENTRIES) {
-                    RTreeNode *sibling = findSibling(child);
-                    if (sibling && sibling->num_entries > MIN_ENTRIES) {
-                        // Borrow a child from the sibling
-                        node->children[i] = sibling->children[sibling->num_entries - 1];
-                        sibling->children[sibling->num_entries - 1]->parent = node;
-                        sibling->num_entries--;
-                        updateBoundingBox(child);
-                        updateBoundingBox(sibling);
-                        updateBoundingBox(node);
-                    } else if (sibling) {
-                        // Merge child with sibling
-                        for (int j = 0; j < sibling->num_entries; j++) {
-                            node->children[i]->children[node->children[i]->num_entries++] = sibling->children[j];
-                            sibling->children[j]->parent = node->children[i];
-                        }
-                        node->num_entries--;
-                        // Remove sibling from parent
-                        for (int j = i; j < node->num_entries; j++) {
-                            node->children[j] = node->children[j + 1];
-                        }
-                        free(sibling);
-                        updateBoundingBox(node->children[i]);
-                        updateBoundingBox(node);
-                    }
-                }
-
-                return;
+        conn->reading = 0;
+        endConcurrentRead(ctree, &ticket);
+    } else if (IS_REQUEST("KNN")) {
+        long long k;
+        const char *p = args;
+        if (!parseCoordinateField(&p, end, &v[0]) || !parseCoordinateField(&p, end, &v[1]) ||
+            !parseIntegerField(&p, end, 0, INT_MAX, &k) || p != end || k < 1) {
+            appendResponse(conn, "ERR usage: KNN x y k\n");
+            return SERVER_CONTINUE;
+        }
+        RTree *tree = beginConcurrentRead(ctree, &ticket);
+        conn->reading = 1;
+        // There can be no more results than sensors, whatever k the client asks for
+        if ((size_t)k > tree->index.count) {
+            k = tree->index.count > 0 ? (long long)tree->index.count : 1;
+        }
+        NeighborResult *neighbors = (NeighborResult *)malloc((size_t)k * sizeof(NeighborResult));
+        if (!neighbors) {
+            fprintf(stderr, "Memory allocation failed for nearest-neighbour results.\n");
+            exit(EXIT_FAILURE);
+        }
+        count = nearestNeighbors(tree->root, v[0], v[1], (int)k, -1, NULL, neighbors);
+        for (int i = 0; i < count; i++) {
+            appendSensorRow(conn, neighbors[i].sensor);
+        }
+        conn->reading = 0;
+        endConcurrentRead(ctree, &ticket);
+        free(neighbors);
+    } else if (IS_REQUEST("INSERT")) {
+        // Inserting at an occupied point replaces that sensor's readings; the count is 0 then
+        const char *p = args;
+        if (!parseCoordinateField(&p, end, &write.record.x) || !parseCoordinateField(&p, end, &write.record.y) ||
+            !parseSensorField(&p, end, &write.record.humidity) || !parseSensorField(&p, end, &write.record.PollutionLevel) ||
+            !parseSensorField(&p, end, &write.record.temperature) || p != end) {
+            appendResponse(conn, "ERR usage: INSERT x y humidity pollution temperature\n");
+            return SERVER_CONTINUE;
+        }
+        applyConcurrentWrite(ctree, serverInsertOp, &write);
+        count = write.count;
+    } else if (IS_REQUEST("DELETE")) {
+        if (!parseRequestCoordinates(args, end, v, 2)) {
+            appendResponse(conn, "ERR usage: DELETE x y\n");
+            return SERVER_CONTINUE;
+        }
+        write.record.x = v[0];
+        write.record.y = v[1];
+        applyConcurrentWrite(ctree, serverDeleteOp, &write);
+        count = write.count;
+    } else if (IS_REQUEST("UPDATE")) {
+        // The readings of a dataset file, such as the next sensors_N.txt, for the sensors already
+        // served. The file is read once, so both instances get the same rows.
+        if (!parseRequestPath(args, end, path, sizeof(path))) {
+            appendResponse(conn, "ERR usage: UPDATE sensor_file\n");
+            return SERVER_CONTINUE;
+        }
+        write.records = readSensorRows(path, &write.num_records);
+        if (!write.records) {
+            appendResponse(conn, "ERR could not open sensor file %s\n", path);
+            return SERVER_CONTINUE;
+        }
+        applyConcurrentWrite(ctree, serverUpdateOp, &write);
+        free(write.records);
+        count = write.count;
+    } else if (IS_REQUEST("LOAD")) {
+        if (!parseRequestPath(args, end, path, sizeof(path))) {
+            appendResponse(conn, "ERR usage: LOAD snapshot_file\n");
+            return SERVER_CONTINUE;
+        }
+        write.loaded[0] = loadRTreeSnapshot(path);
+        write.loaded[1] = write.loaded[0] ? loadRTreeSnapshot(path) : NULL;
+        if (!write.loaded[1]) {
+            if (write.loaded[0]) {
+                destroyRTree(write.loaded[0]);
             }
+            appendResponse(conn, "ERR could not load snapshot %s\n", path);
+            return SERVER_CONTINUE;
         }
+        applyConcurrentWrite(ctree, serverLoadOp, &write);
+        count = write.count;
+    } else if (IS_REQUEST("QUIT")) {
+        appendResponse(conn, "OK 0\n");
+        return SERVER_CLOSE;
+    } else if (IS_REQUEST("SHUTDOWN")) {
+        appendResponse(conn, "OK 0\n");
+        return SERVER_SHUTDOWN;
+    } else {
+        appendResponse(conn, "ERR unknown request %.*s\n", (int)(length < 32 ? length : 32), start);
+        return SERVER_CONTINUE;
     }
+#undef IS_REQUEST
+
+    appendResponse(conn, "OK %d\n", count);
+    return SERVER_CONTINUE;
 }
-// Search for a sensor with specific coordinates in the R-tree
-SensorNode *searchSensorInRTree(RTreeNode *node, SensorNode *target) {
-    
-    BoundingBox targetBBox = createBoundingBoxForSensor(target);
-    if (!overlaps(&node->bbox, &targetBBox)) {
-        return NULL;  // Skip nodes that don't overlap
-   
+
+// Answer the requests of one client until it disconnects or sends QUIT or SHUTDOWN. Requests
+// may be pipelined: every complete request already received is answered before the batch of
+// responses is written, so a client can send many requests without waiting for each reply.
+ServerAction serveConnection(ConcurrentRTree *ctree, int in_fd, int out_fd) {
+    ServerConnection conn = {in_fd, out_fd, NULL, 0, 0, NULL, 0, 0, 0, 0};
+    ServerAction action = SERVER_CONTINUE;
+    int at_eof = 0, skipping = 0;
+    conn.input = (char *)malloc(SERVER_INPUT_SIZE);
+    if (!conn.input) {
+        fprintf(stderr, "Memory allocation failed for server requests.\n");
+        exit(EXIT_FAILURE);
     }
-    if (node->is_leaf) {
-        // Look for a matching sensor in the leaf node
-        for (int i = 0; i < node->num_entries; i++) {
-            if (node->sensors[i]->x == target->x && node->sensors[i]->y == target->y) {
-                return node->sensors[i];  
+    reserveResponse(&conn, SERVER_FLUSH_BYTES);
+
+    while (action == SERVER_CONTINUE && !conn.closed) {
+        char *start = conn.input + conn.input_position;
+        char *newline = (char *)memchr(start, '\n', conn.input_length - conn.input_position);
+        if (newline || (at_eof && conn.input_position < conn.input_length)) {
+            // The last request before end of input may lack a newline
+            char *end = newline ? newline : conn.input + conn.input_length;
+            conn.input_position = newline ? (size_t)(newline + 1 - conn.input) : conn.input_length;
+            if (skipping) {
+                skipping = 0;
+                continue;
+            }
+            while (end > start && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) {
+                end--;
             }
+            if (end > start) {
+                action = handleServerRequest(ctree, &conn, start, end);
+            }
+            continue;
         }
-    } else {
-        // Traverse child nodes for internal nodes
-        for (int i = 0; i < node->num_entries; i++) {
-            SensorNode *result = searchSensorInRTree(node->children[i], target);
-            if (result != NULL) {
-                return result;  // Found sensor in a child node
+        if (at_eof) {
+            break;
+        }
+
+        // Out of complete requests: send the responses, then wait for more input. The partial
+        // request left in the buffer moves to its front; one that fills it is rejected.
+        flushResponses(&conn);
+        memmove(conn.input, start, conn.input_length - conn.input_position);
+        conn.input_length -= conn.input_position;
+        conn.input_position = 0;
+        if (conn.input_length == SERVER_INPUT_SIZE) {
+            if (!skipping) {
+                appendResponse(&conn, "ERR request longer than %d bytes\n", SERVER_INPUT_SIZE);
             }
+            skipping = 1;
+            conn.input_length = 0;
+        }
+        ssize_t n = read(conn.in_fd, conn.input + conn.input_length, SERVER_INPUT_SIZE - conn.input_length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            fprintf(stderr, "Error: Could not read server requests: %s.\n", strerror(errno));
+        }
+        if (n <= 0) {
+            at_eof = 1;
+        } else {
+            conn.input_length += (size_t)n;
         }
     }
-    return NULL;  // Sensor not found in this branch
+
+    flushResponses(&conn);
+    free(conn.input);
+    free(conn.output);
+    return action;
 }
 
-// Function to write sensor nodes to a file for heatmap plotting
-void writeSensorNodesToFile(RTreeNode *node, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        printf("Error opening file %s for writing sensor nodes.\n", filename);
-        return;
-    }
+// Thread of one socket client. The first SHUTDOWN wakes the accept loop and ends the input of
+// the other clients, which still answer the requests they have already received.
+void *serveSocketClient(void *arg) {
+    SocketClient *client = (SocketClient *)arg;
+    SocketServer *server = client->server;
+    ServerAction action = serveConnection(server->ctree, client->fd, client->fd);
 
-    if (node->is_leaf) {
-        for (int i = 0; i < node->num_entries; i++) {
-            fprintf(file, "%d %d %d\n", node->sensors[i]->x, node->sensors[i]->y, node->sensors[i]->temperature);
-        }
-    } else {
-        for (int i = 0; i < node->num_entries; i++) {
-            writeSensorNodesToFile(node->children[i], filename);
+    pthread_mutex_lock(&server->lock);
+    if (action == SERVER_SHUTDOWN && !server->shutting_down) {
+        server->shutting_down = 1;
+        shutdown(server->listener, SHUT_RDWR);
+        for (SocketClient *other = server->clients; other; other = other->next) {
+            if (other != client) {
+                shutdown(other->fd, SHUT_RD);
+            }
         }
     }
+    SocketClient **link = &server->clients;
+    while (*link != client) {
+        link = &(*link)->next;
+    }
+    *link = client->next;
+    if (!server->clients) {
+        pthread_cond_signal(&server->idle);
+    }
+    pthread_mutex_unlock(&server->lock);
 
-    fclose(file);
+    close(client->fd);
+    free(client);
+    return NULL;
 }
 
-void writeBoundingBoxesToFile(RTreeNode *node, const char *filename) {
-    FILE *file = fopen(filename, "a");
-    if (!file) {
-        printf("Error opening file %s for writing bounding boxes.\n", filename);
-        return;
+// Serve clients of a Unix domain socket at path, each on its own thread, until a client sends
+// SHUTDOWN; then wait for every client to finish. Returns EXIT_SUCCESS or EXIT_FAILURE for main.
+int serveUnixSocket(ConcurrentRTree *ctree, const char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path %s is too long.\n", path);
+        return EXIT_FAILURE;
     }
-
-    if (node->is_leaf || node->num_entries > 0) {
-        
-        fprintf(file, "%d %d\n", node->bbox.min_x, node->bbox.min_y);  // Bottom-left
-        fprintf(file, "%d %d\n", node->bbox.max_x, node->bbox.min_y);  // Bottom-right
-        fprintf(file, "%d %d\n", node->bbox.max_x, node->bbox.max_y);  // Top-right
-        fprintf(file, "%d %d\n", node->bbox.min_x, node->bbox.max_y);  // Top-left
-        fprintf(file, "%d %d\n\n", node->bbox.min_x, node->bbox.min_y);  // Close the rectangle
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        fprintf(stderr, "Error: Could not create socket: %s.\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+        fprintf(stderr, "Error: Could not listen on %s: %s.\n", path, strerror(errno));
+        close(listener);
+        return EXIT_FAILURE;
     }
+    fprintf(stderr, "Serving %zu sensors on %s.\n", ctree->instances[0]->index.count, path);
 
-    if (!node->is_leaf) {
-        for (int i = 0; i < node->num_entries; i++) {
-            writeBoundingBoxesToFile(node->children[i], filename);
+    SocketServer server = {ctree, listener, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0};
+    while (1) {
+        int fd = accept(listener, NULL, NULL);
+        pthread_mutex_lock(&server.lock);
+        if (server.shutting_down) {
+            pthread_mutex_unlock(&server.lock);
+            if (fd >= 0) {
+                close(fd);
+            }
+            break;
+        }
+        if (fd < 0) {
+            pthread_mutex_unlock(&server.lock);
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error: Could not accept a connection: %s.\n", strerror(errno));
+            break;
         }
+
+        SocketClient *client = (SocketClient *)malloc(sizeof(SocketClient));
+        if (!client) {
+            fprintf(stderr, "Memory allocation failed for server client.\n");
+            exit(EXIT_FAILURE);
+        }
+        client->server = &server;
+        client->fd = fd;
+        client->next = server.clients;
+        server.clients = client;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serveSocketClient, client) != 0) {
+            fprintf(stderr, "Error: Could not start a thread for a connection.\n");
+            server.clients = client->next;
+            close(fd);
+            free(client);
+        } else {
+            pthread_detach(thread);
+        }
+        pthread_mutex_unlock(&server.lock);
     }
 
-    fclose(file);
+    // The tree must outlive every client thread
+    pthread_mutex_lock(&server.lock);
+    while (server.clients) {
+        pthread_cond_wait(&server.idle, &server.lock);
+    }
+    int status = server.shutting_down ? EXIT_SUCCESS : EXIT_FAILURE;
+    pthread_mutex_unlock(&server.lock);
+    close(listener);
+    unlink(path);
+    return status;
 }
 
-
 // Main function
-int main() {
-    // Initialize R-Tree root node (leaf node by default)
-    RTreeNode *root = createRTreeNode(1);
-
+int main(int argc, char **argv) {
     // File loading setup
     const char *folder = "sensors";
     int file_index = 1;
     char file_path[256];
-    sprintf(file_path, "%s/sensors_%d.txt", folder, file_index);
+    const char *snapshot_file = NULL;
+    SplitPolicy policy = DEFAULT_SPLIT_POLICY;
+    int keep_history = 0;
+    const char *heatmap_prefix = NULL;
+    char heatmap_path[300];
+    int run_bench = 0;
+    int serve = 0;
+    const char *socket_path = NULL;
+    BenchConfig bench = {BENCH_DEFAULT_SENSORS, BENCH_DEFAULT_OPERATIONS, DIST_FIRE, DEFAULT_SPLIT_POLICY, 1};
+    RTree *tree;
 
-    // Attempt to load the first dataset
-    FILE *file = fopen(file_path, "r");
-    if (!file) {
-        fprintf(stderr, "Error: Could not open initial dataset file %s.\n", file_path);
-        return EXIT_FAILURE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            snapshot_file = argv[++i];
+        } else if (strcmp(argv[i], "--split") == 0 && i + 1 < argc && parseSplitPolicy(argv[i + 1], &policy)) {
+            i++;
+        } else if (strcmp(argv[i], "--history") == 0) {
+            keep_history = 1;
+        } else if (strcmp(argv[i], "--heatmap") == 0 && i + 1 < argc) {
+            heatmap_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            serve = 1;
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            serve = 1;
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            run_bench = 1;
+        } else if (strcmp(argv[i], "--sensors") == 0 && i + 1 < argc && parseBenchCount(argv[i + 1], &bench.num_sensors)) {
+            i++;
+        } else if (strcmp(argv[i], "--operations") == 0 && i + 1 < argc &&
+                   parseBenchCount(argv[i + 1], &bench.num_operations)) {
+            i++;
+        } else if (strcmp(argv[i], "--distribution") == 0 && i + 1 < argc &&
+                   parseDistribution(argv[i + 1], &bench.distribution)) {
+            i++;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            bench.seed = strtoull(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--snapshot FILE] [--split linear|quadratic|rstar] [--history] [--heatmap PREFIX]\n"
+                            "       %s --bench [--sensors N] [--operations N] [--distribution uniform|clustered|fire]\n"
+                            "          [--seed N] [--split linear|quadratic|rstar]\n"
+                            "       %s --serve [--socket PATH] [--snapshot FILE] [--split linear|quadratic|rstar]\n"
+                            "          (the server starts from an empty tree unless --snapshot is given)\n",
+                    argv[0], argv[0], argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (run_bench) {
+        if (bench.num_sensors > BENCH_MAX_RECORDS - bench.num_operations) {
+            fprintf(stderr, "Error: --sensors and --operations may add up to at most %d.\n", BENCH_MAX_RECORDS);
+            return EXIT_FAILURE;
+        }
+        bench.policy = policy;
+        return runBenchmark(&bench);
     }
 
-    // Load sensor data into R-Tree
-    int x, y, humidity, PollutionLevel, temperature;
-    printf("Loading data from %s...\n", file_path);
-    while (fscanf(file, "%d %d %d %d %d", &x, &y, &humidity, &PollutionLevel, &temperature) != EOF) {
-        SensorNode *sensor = (SensorNode *)malloc(sizeof(SensorNode));
-        if (!sensor) {
-            fprintf(stderr, "Memory allocation failed for sensor node.\n");
-            fclose(file);
+    // Server mode starts from the snapshot if one is given, otherwise from an empty tree,
+    // and keeps standard output for responses. The tree is held as a ConcurrentRTree, so
+    // socket clients on separate threads can query it while another one writes.
+    if (serve) {
+        RTree *instances[2];
+        for (int i = 0; i < 2; i++) {
+            instances[i] = snapshot_file ? loadRTreeSnapshot(snapshot_file) : createRTree(policy);
+        }
+        if (!instances[0] || !instances[1]) {
+            for (int i = 0; i < 2; i++) {
+                if (instances[i]) {
+                    destroyRTree(instances[i]);
+                }
+            }
             return EXIT_FAILURE;
         }
-        sensor->x = x;
-        sensor->y = y;
-        sensor->humidity = humidity;
-        sensor->PollutionLevel = PollutionLevel;
-        sensor->temperature = temperature;
-        insertSensorIntoRTree(root, sensor);
+        ConcurrentRTree *ctree = wrapConcurrentRTree(instances[0], instances[1]);
+        signal(SIGPIPE, SIG_IGN);
+        int status = EXIT_SUCCESS;
+        if (socket_path) {
+            status = serveUnixSocket(ctree, socket_path);
+        } else {
+            serveConnection(ctree, STDIN_FILENO, STDOUT_FILENO);
+        }
+        destroyConcurrentRTree(ctree);
+        return status;
+    }
+
+    // Start from a saved snapshot if one is given, otherwise from the first dataset.
+    // A snapshot keeps the split policy it was saved with.
+    if (snapshot_file) {
+        printf("Opening snapshot %s...\n", snapshot_file);
+        tree = loadRTreeSnapshot(snapshot_file);
+    } else {
+        sprintf(file_path, "%s/sensors_%d.txt", folder, file_index);
+        tree = loadSensorFile(file_path, policy);
+    }
+    if (!tree) {
+        return EXIT_FAILURE;
+    }
+    if (keep_history) {
+        enableSensorHistory(tree);
     }
-    fclose(file);
     printf("Data loaded successfully.\n");
+    if (heatmap_prefix) {
+        // One frame of mean temperatures per dataset, covering the whole tree
+        snprintf(heatmap_path, sizeof(heatmap_path), "%s_%d.ppm", heatmap_prefix, file_index);
+        writeHeatmap(tree->root, &tree->root->bbox, RASTER_MEAN, heatmap_path);
+    }
 
     // Interactive menu loop
     char option;
     while (1) {
+        // Report what changed in the watched zones since the last command
+        StandingEvent events[QUERY_BATCH_SIZE];
+        int num_events;
+        while ((num_events = fetchStandingEvents(tree, events, QUERY_BATCH_SIZE)) > 0) {
+            for (int i = 0; i < num_events; i++) {
+                static const char *what[] = {"entered", "left", "rose above the threshold", "fell below the threshold"};
+                printf("Zone %d: sensor at " POINT_FORMAT " %s (temperature %d)\n", events[i].query_id,
+                       events[i].sensor.x, events[i].sensor.y, what[events[i].type], events[i].sensor.temperature);
+            }
+        }
+
         // Display menu options
         printf("\nOptions:\n");
         printf("  A - Perform a range query\n");
         printf("  B - Detect fire in a specified area\n");
         printf("  C - Update R-tree (Insert/Delete sensor)\n");
+        if (tree->history) {
+            printf("  E - Find sensors that exceeded a temperature during a time interval\n");
+        }
+        printf("  H - Find fire alarms (hot and dry sensors) in an area\n");
+        printf("  I - Show index statistics\n");
+        printf("  J - Count the sensors in each zone of a zone file\n");
+        printf("  K - Find the nearest sensors to a point\n");
         printf("  N - Load the next dataset file\n");
+        printf("  S - Save the tree to a snapshot file\n");
+        printf("  T - List the hottest sensors in an area\n");
+        printf("  U - Stop watching a zone\n");
+        printf("  W - Watch a zone for changes\n");
+        printf("  Z - Summarise the readings in a zone\n");
         printf("  Q - Quit the program\n");
         printf("Enter your choice: ");
         scanf(" %c", &option);
@@ -515,14 +5425,13 @@ int main() {
         }
         else if (option == 'A') {
         // Perform a range query
-        int min_x, min_y, max_x, max_y;
+        coord_t min_x, min_y, max_x, max_y;
         printf("Enter range query coordinates (min_x min_y max_x max_y): ");
-        scanf("%d %d %d %d", &min_x, &min_y, &max_x, &max_y);
+        scanf(BOX_SCAN, &min_x, &min_y, &max_x, &max_y);
         BoundingBox *query_box = createBoundingBox(min_x, min_y, max_x, max_y);
         printf("Performing range query...\n");
 
-        int count = 0; 
-        rangeQuery(root, query_box, printSensor, &count);
+        int count = printRangeQuery(tree->root, query_box);
 
         if (count == 0) {
             printf("No nodes in the range given.\n");
@@ -532,94 +5441,256 @@ int main() {
         }
         else if (option == 'B') {
             // Fire detection in a specified area
-            int center_x, center_y, radius;
+            coord_t center_x, center_y, radius;
             printf("Enter center coordinates (x, y) and detection radius: ");
-            scanf("%d %d %d", &center_x, &center_y, &radius);
+            scanf(COORD_SCAN " " COORD_SCAN " " COORD_SCAN, &center_x, &center_y, &radius);
 
             // Define the bounding box based on user input
             BoundingBox *query_box = createBoundingBox(center_x - radius, center_y - radius, center_x + radius, center_y + radius);
-            int count=0;
-            // Perform the range query and visualize
-            printf("Detecting fire in area (%d, %d) with radius %d...\n", center_x, center_y, radius);
-            rangeQuery(root, query_box, printSensor,&count);
-
-            // Output query bounding box to file for visualization
-            FILE *file = fopen("bounding_boxes.dat", "w");
-            if (file) {
-                fprintf(file, "%d %d\n", query_box->min_x, query_box->min_y);  // Bottom-left
-                fprintf(file, "%d %d\n", query_box->max_x, query_box->min_y);  // Bottom-right
-                fprintf(file, "%d %d\n", query_box->max_x, query_box->max_y);  // Top-right
-                fprintf(file, "%d %d\n", query_box->min_x, query_box->max_y);  // Top-left
-                fprintf(file, "%d %d\n\n", query_box->min_x, query_box->min_y);  // Close the rectangle
-                fclose(file);
-            }
-
-            // Write sensor nodes to file and display plot
-            writeSensorNodesToFile(root, "sensor_nodes.dat");
-            system("gnuplot -persist -e \"set terminal qt; \
-    set xlabel 'X'; \
-    set ylabel 'Y'; \
-    set cblabel 'Temperature (°C)'; \
-    set cbrange [30:100]; \
-    set palette defined (30 'blue', 40 'cyan', 60 'green', 80 'yellow', 100 'red'); \
-    set xrange [0:1000]; \
-    set yrange [0:1000]; \
-    plot 'sensor_nodes.dat' using 1:2:3 with points pt 7 ps 1 palette notitle, \
-    'bounding_boxes.dat' using 1:2 with lines lw 2 lc rgb 'black' notitle\""); 
+            // Perform the radius query and visualize
+            printf("Detecting fire in area " POINT_FORMAT " with radius " COORD_FORMAT "...\n", center_x, center_y,
+                   radius);
+            QueryCursor cursor;
+            openRadiusCursor(&cursor, tree->root, center_x, center_y, radius, NULL);
+            if (printQueryResults(&cursor) == 0) {
+                printf("No sensors within the given radius.\n");
+            }
+
+            // Render the hottest reading of each cell of the detection area
+            if (writeHeatmap(tree->root, query_box, RASTER_MAX, "heatmap.ppm") == 0) {
+                printf("Heatmap of the area written to heatmap.ppm.\n");
+            }
             free(query_box);
         }
+        else if (option == 'E' && tree->history) {
+            // Spatio-temporal query over the recorded timesteps
+            BoundingBox area;
+            int threshold, first_step, last_step;
+            printf("Enter area coordinates (min_x min_y max_x max_y): ");
+            scanf(BOX_SCAN, &area.min_x, &area.min_y, &area.max_x, &area.max_y);
+            printf("Enter temperature threshold and time interval t1 t2 (1 to %d): ", tree->history->num_steps);
+            scanf("%d %d %d", &threshold, &first_step, &last_step);
+
+            int capacity = tree->index.count > 0 ? (int)tree->index.count : 1;
+            SensorNode **exceeded = (SensorNode **)malloc(capacity * sizeof(SensorNode *));
+            if (!exceeded) {
+                fprintf(stderr, "Memory allocation failed for history results.\n");
+                continue;
+            }
+            int found = historyExceedances(tree, &area, threshold, first_step, last_step, exceeded, capacity);
+            for (int i = 0; i < found; i++) {
+                printf("Sensor at " POINT_FORMAT " exceeded %d between t=%d and t=%d\n", exceeded[i]->x, exceeded[i]->y,
+                       threshold, first_step, last_step);
+            }
+            if (found == 0) {
+                printf("No sensor in this area exceeded %d in that interval.\n", threshold);
+            }
+            free(exceeded);
+        }
+        else if (option == 'W') {
+            // Register a standing query; its events are printed before each menu
+            BoundingBox zone;
+            int threshold;
+            printf("Enter zone coordinates (min_x min_y max_x max_y): ");
+            scanf(BOX_SCAN, &zone.min_x, &zone.min_y, &zone.max_x, &zone.max_y);
+            printf("Enter a temperature threshold to watch, or N for none: ");
+            int has_threshold = scanf("%d", &threshold) == 1;
+            if (!has_threshold) {
+                scanf(" %*s");
+            }
+            printf("Watching zone %d.\n", addStandingQuery(tree, &zone, has_threshold, threshold));
+        }
+        else if (option == 'U') {
+            int zone_id;
+            printf("Enter the number of the zone to stop watching: ");
+            if (scanf("%d", &zone_id) != 1) {
+                scanf(" %*s");
+                printf("Invalid zone number.\n");
+            } else if (removeStandingQuery(tree, zone_id)) {
+                printf("Stopped watching zone %d.\n", zone_id);
+            } else {
+                printf("Zone %d is not being watched.\n", zone_id);
+            }
+        }
+        else if (option == 'H') {
+            // Alarm query: subtrees whose temperature and humidity ranges cannot raise an alarm are skipped
+            BoundingBox area;
+            SensorFilter alarm;
+            initSensorFilter(&alarm);
+            printf("Enter area coordinates (min_x min_y max_x max_y): ");
+            scanf(BOX_SCAN, &area.min_x, &area.min_y, &area.max_x, &area.max_y);
+            printf("Enter alarm temperature (at or above) and humidity (at or below): ");
+            scanf("%d %d", &alarm.min_temperature, &alarm.max_humidity);
+
+            QueryCursor cursor;
+            openFilteredRangeCursor(&cursor, tree->root, &area, &alarm);
+            int alarms = printQueryResults(&cursor);
+            if (alarms == 0) {
+                printf("No alarms in this area.\n");
+            } else {
+                printf("%d sensors raised an alarm.\n", alarms);
+            }
+        }
+        else if (option == 'I') {
+            // Tree shape, plus the event counters since the last time they were shown
+            printTreeStats(tree, stdout);
+#ifdef RTREE_STATS
+            resetRTreeCounters();
+#endif
+        }
+        else if (option == 'J') {
+            // Spatial join of the tree against a file of zones
+            char zone_path[256];
+            printf("Enter zone file name: ");
+            scanf("%255s", zone_path);
+            int num_zones;
+            BoundingBox *zones = loadZoneFile(zone_path, &num_zones);
+            if (!zones) {
+                continue;
+            }
+
+            MultiQueryResult joined;
+            spatialJoinZones(tree->root, zones, num_zones, &joined);
+            for (int z = 0; z < num_zones; z++) {
+                printf("Zone %d " POINT_FORMAT "-" POINT_FORMAT ": %d sensors\n", z + 1, zones[z].min_x, zones[z].min_y,
+                       zones[z].max_x, zones[z].max_y, joined.offsets[z + 1] - joined.offsets[z]);
+            }
+            printf("%d zones, %d sensor hits.\n", num_zones, joined.num_results);
+            freeMultiQueryResult(&joined);
+            free(zones);
+        }
+        else if (option == 'T') {
+            // Top-k hottest sensors
+            BoundingBox area;
+            int k;
+            printf("Enter area coordinates (min_x min_y max_x max_y) and number of sensors k: ");
+            scanf(BOX_SCAN " %d", &area.min_x, &area.min_y, &area.max_x, &area.max_y, &k);
+            if (k <= 0) {
+                printf("k must be positive.\n");
+                continue;
+            }
+
+            SensorNode **hottest = (SensorNode **)malloc(k * sizeof(SensorNode *));
+            if (!hottest) {
+                fprintf(stderr, "Memory allocation failed for hottest sensor results.\n");
+                continue;
+            }
+            int found = hottestSensors(tree->root, &area, k, NULL, hottest);
+            for (int i = 0; i < found; i++) {
+                printSensor(hottest[i]);
+            }
+            if (found == 0) {
+                printf("No sensors in this area.\n");
+            }
+            free(hottest);
+        }
         else if (option == 'C') {
             // Update R-tree: Insert or delete a sensor
             char update_option;
-            printf("Enter I to insert a new sensor or D to delete an existing sensor: ");
+            printf("Enter I to insert a new sensor, D to delete an existing sensor or R to delete every sensor in a region: ");
             scanf(" %c", &update_option);
 
             if (update_option == 'I') {
-                SensorNode *sensor = (SensorNode *)malloc(sizeof(SensorNode));
-                if (!sensor) {
-                    fprintf(stderr, "Memory allocation failed for new sensor.\n");
-                    continue;
-                }
+                SensorNode record;
                 printf("Enter coordinates (x, y) of the new sensor: ");
-                scanf("%d %d", &sensor->x, &sensor->y);
+                scanf(COORD_SCAN " " COORD_SCAN, &record.x, &record.y);
                 printf("Enter humidity, pollution level, and temperature: ");
-                scanf("%d %d %d", &sensor->humidity, &sensor->PollutionLevel, &sensor->temperature);
-                insertSensorIntoRTree(root, sensor);
-                printf("Sensor inserted successfully.\n");
+                scanf("%d %d %d", &record.humidity, &record.PollutionLevel, &record.temperature);
+                if (insertOrUpdateSensor(tree, &record)) {
+                    printf("Sensor inserted successfully.\n");
+                } else {
+                    printf("A sensor already exists at these coordinates; its readings were updated.\n");
+                }
             }
             else if (update_option == 'D') {
                 SensorNode sensor;
                 printf("Enter coordinates (x, y) of the sensor to delete: ");
-                scanf("%d %d", &sensor.x, &sensor.y);
-                deleteSensorFromRTree(root, &sensor);
-                printf("Sensor deleted successfully (if it existed).\n");
+                scanf(COORD_SCAN " " COORD_SCAN, &sensor.x, &sensor.y);
+                if (deleteSensorFromRTree(tree, &sensor)) {
+                    printf("Sensor deleted successfully.\n");
+                } else {
+                    printf("Sensor not found in the tree.\n");
+                }
+            }
+            else if (update_option == 'R') {
+                BoundingBox region;
+                printf("Enter region coordinates (min_x, min_y, max_x, max_y): ");
+                scanf(BOX_SCAN, &region.min_x, &region.min_y, &region.max_x, &region.max_y);
+                printf("Deleted %d sensors.\n", deleteSensorsInRegion(tree, &region));
             }
             else {
-                printf("Invalid option. Please enter 'I' or 'D'.\n");
+                printf("Invalid option. Please enter 'I', 'D' or 'R'.\n");
+            }
+        }
+        else if (option == 'K') {
+            // k-nearest-neighbour search
+            coord_t point_x, point_y;
+            int k;
+            printf("Enter point coordinates (x, y) and number of sensors k: ");
+            scanf(COORD_SCAN " " COORD_SCAN " %d", &point_x, &point_y, &k);
+            if (k <= 0) {
+                printf("k must be positive.\n");
+                continue;
+            }
+
+            NeighborResult *neighbors = (NeighborResult *)malloc(k * sizeof(NeighborResult));
+            if (!neighbors) {
+                fprintf(stderr, "Memory allocation failed for nearest-neighbour results.\n");
+                continue;
+            }
+            int found = nearestNeighbors(tree->root, point_x, point_y, k, -1, NULL, neighbors);
+            for (int i = 0; i < found; i++) {
+                printf("Distance %.1f: ", sqrt((double)neighbors[i].dist_sq));
+                printSensor(neighbors[i].sensor);
             }
+            if (found == 0) {
+                printf("No sensors in the tree.\n");
+            }
+            free(neighbors);
+        }
+        else if (option == 'Z') {
+            // Zone statistics from the per-node aggregates
+            BoundingBox zone;
+            SensorAggregate stats;
+            printf("Enter zone coordinates (min_x min_y max_x max_y): ");
+            scanf(BOX_SCAN, &zone.min_x, &zone.min_y, &zone.max_x, &zone.max_y);
+            if (regionAggregate(tree->root, &zone, &stats) == 0) {
+                printf("No sensors in this zone.\n");
+                continue;
+            }
+            printf("Sensors: %lld\n", stats.count);
+            printf("Humidity: avg %.2f, min %d, max %d\n", (double)stats.sum_humidity / stats.count,
+                   stats.min_humidity, stats.max_humidity);
+            printf("Pollution Level: avg %.2f, min %d, max %d\n", (double)stats.sum_pollution / stats.count,
+                   stats.min_pollution, stats.max_pollution);
+            printf("Temperature: avg %.2f, min %d, max %d\n", (double)stats.sum_temperature / stats.count,
+                   stats.min_temperature, stats.max_temperature);
         }
         else if (option == 'N') {
             // Load the next dataset file
             file_index++;
             sprintf(file_path, "%s/sensors_%d.txt", folder, file_index);
-            file = fopen(file_path, "r");
 
-            if (!file) {
+            printf("Loading data from %s...\n", file_path);
+            if (updateSensorsFromFile(tree, file_path) < 0) {
                 printf("No more files available.\n");
-                file_index--;              }
+                file_index--;
+            }
             else {
-                printf("Loading data from %s...\n", file_path);
-                while (fscanf(file, "%d %d %d %d %d", &x, &y, &humidity, &PollutionLevel, &temperature) != EOF) {
-                    SensorNode temp_sensor = {x, y, humidity, PollutionLevel, temperature};
-                    SensorNode *existing_sensor = searchSensorInRTree(root, &temp_sensor);
-                    if (existing_sensor) {
-                        existing_sensor->humidity = humidity;
-                        existing_sensor->PollutionLevel = PollutionLevel;
-                        existing_sensor->temperature = temperature;
-                    }
-                }
-                fclose(file);
                 printf("Data from %s loaded successfully.\n", file_path);
+                if (heatmap_prefix) {
+                    snprintf(heatmap_path, sizeof(heatmap_path), "%s_%d.ppm", heatmap_prefix, file_index);
+                    writeHeatmap(tree->root, &tree->root->bbox, RASTER_MEAN, heatmap_path);
+                }
+            }
+        }
+        else if (option == 'S') {
+            // Save a binary snapshot that can be reopened with --snapshot
+            char snapshot_path[256];
+            printf("Enter snapshot file name: ");
+            scanf("%255s", snapshot_path);
+            if (saveRTreeSnapshot(tree, snapshot_path) == 0) {
+                printf("Snapshot saved to %s.\n", snapshot_path);
             }
         }
         else {
@@ -627,6 +5698,7 @@ int main() {
         }
     }
 
+    destroyRTree(tree);
     return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,1349 @@
+// Tests for the R-tree in main.c. The program is included whole, with its main renamed, so the
+// tests can reach every function; run them with `make test`.
+#define main rtree_main
+#include "../main.c"
+#undef main
+
+#define TEST_SIDE 512          // Sensors are placed on a TEST_SIDE x TEST_SIDE grid
+#define TEST_QUERIES 200       // Random boxes compared against brute force after each phase
+
+static int checks_run = 0;
+static int checks_failed = 0;
+
+#define CHECK(condition, ...)                                                   \
+    do {                                                                        \
+        checks_run++;                                                           \
+        if (!(condition)) {                                                     \
+            checks_failed++;                                                    \
+            fprintf(stderr, "%s:%d: check failed: ", __FILE__, __LINE__);       \
+            fprintf(stderr, __VA_ARGS__);                                       \
+            fprintf(stderr, "\n");                                              \
+        }                                                                       \
+    } while (0)
+
+// Brute-force model of the tree: the temperature of the sensor at each grid point, -1 if none
+static int model[TEST_SIDE][TEST_SIDE];
+static int model_count;
+
+// Random number in [0, bound) from a fixed-seed generator, so failures can be reproduced
+static uint64_t test_state;
+static int testRandom(int bound) {
+    return (int)(benchRandom(&test_state) % (uint64_t)bound);
+}
+
+// Random box inside the grid, up to a quarter of its side across
+static BoundingBox randomTestBox(void) {
+    BoundingBox box;
+    box.min_x = testRandom(TEST_SIDE);
+    box.min_y = testRandom(TEST_SIDE);
+    box.max_x = box.min_x + testRandom(TEST_SIDE / 4);
+    box.max_y = box.min_y + testRandom(TEST_SIDE / 4);
+    if (box.max_x >= TEST_SIDE) {
+        box.max_x = TEST_SIDE - 1;
+    }
+    if (box.max_y >= TEST_SIDE) {
+        box.max_y = TEST_SIDE - 1;
+    }
+    return box;
+}
+
+// Sensors of the model inside a box
+static int modelCount(BoundingBox *box) {
+    int count = 0;
+    for (int x = (int)box->min_x; x <= (int)box->max_x; x++) {
+        for (int y = (int)box->min_y; y <= (int)box->max_y; y++) {
+            count += model[x][y] >= 0;
+        }
+    }
+    return count;
+}
+
+// Sensors of the tree inside a box, through a range cursor
+static int treeCount(RTree *tree, BoundingBox *box) {
+    QueryCursor cursor;
+    SensorNode *batch[64];
+    int count = 0, fetched;
+    openRangeCursor(&cursor, tree->root, box);
+    while ((fetched = fetchRangeResults(&cursor, batch, 64)) > 0) {
+        count += fetched;
+    }
+    return count;
+}
+
+// Aggregate of the sensors of a tree inside a box, scanned point by point through the
+// coordinate index rather than through the tree
+static void scanAggregate(RTree *tree, BoundingBox *box, SensorAggregate *result) {
+    initSensorAggregate(result);
+    for (int x = (int)box->min_x; x <= (int)box->max_x; x++) {
+        for (int y = (int)box->min_y; y <= (int)box->max_y; y++) {
+            SensorNode *sensor = findSensorAt(tree, x, y);
+            if (sensor) {
+                addSensorToAggregate(result, sensor);
+            }
+        }
+    }
+}
+
+// Fold every sensor below node into result, leaf by leaf, ignoring the stored aggregates
+static void subtreeAggregate(RTreeNode *node, SensorAggregate *result) {
+    for (int i = 0; i < node->num_entries; i++) {
+        if (node->is_leaf) {
+            addSensorToAggregate(result, node->sensors[i]);
+        } else {
+            subtreeAggregate(node->children[i], result);
+        }
+    }
+}
+
+// Nodes whose stored aggregate differs from the one of the sensors below them
+static int staleAggregates(RTreeNode *node) {
+    SensorAggregate expected;
+    initSensorAggregate(&expected);
+    subtreeAggregate(node, &expected);
+    int stale = memcmp(&expected, &node->aggregate, sizeof(SensorAggregate)) != 0;
+    for (int i = 0; !node->is_leaf && i < node->num_entries; i++) {
+        stale += staleAggregates(node->children[i]);
+    }
+    return stale;
+}
+
+// Validate the tree and compare it with the model: sensor count, every sensor's readings,
+// range queries over random boxes, and the aggregates of every node and of random regions
+static void checkAgainstModel(RTree *tree, const char *phase) {
+    CHECK(validateRTree(tree) == 0, "%s: tree is not valid", phase);
+    CHECK(tree->index.count == (size_t)model_count, "%s: tree holds %zu sensors, model %d", phase,
+          tree->index.count, model_count);
+
+    int wrong = 0;
+    for (int x = 0; x < TEST_SIDE; x++) {
+        for (int y = 0; y < TEST_SIDE; y++) {
+            SensorNode *sensor = findSensorAt(tree, x, y);
+            if (model[x][y] >= 0 ? !sensor || sensor->temperature != model[x][y] : sensor != NULL) {
+                wrong++;
+            }
+        }
+    }
+    CHECK(wrong == 0, "%s: %d grid points differ from the model", phase, wrong);
+
+    for (int q = 0; q < TEST_QUERIES; q++) {
+        BoundingBox box = randomTestBox();
+        int expected = modelCount(&box);
+        int found = treeCount(tree, &box);
+        CHECK(found == expected, "%s: range query found %d sensors, expected %d", phase, found, expected);
+    }
+
+    int stale = staleAggregates(tree->root);
+    CHECK(stale == 0, "%s: %d nodes hold aggregates that differ from their sensors", phase, stale);
+    // The first region covers the whole grid, which takes the root's aggregate as it is
+    for (int q = 0; q < TEST_QUERIES; q++) {
+        BoundingBox box = q == 0 ? (BoundingBox){0, 0, TEST_SIDE - 1, TEST_SIDE - 1} : randomTestBox();
+        SensorAggregate expected, found;
+        scanAggregate(tree, &box, &expected);
+        int count = regionAggregate(tree->root, &box, &found);
+        CHECK(count == expected.count && memcmp(&found, &expected, sizeof(SensorAggregate)) == 0,
+              "%s: region aggregate of %d sensors differs from a scan of %lld", phase, count, expected.count);
+    }
+}
+
+// Random inserts (some at occupied points), reading updates, single deletes,
+// batched list deletes and region deletes under one split policy
+static void testRandomOperations(SplitPolicy policy) {
+    char phase[64];
+    RTree *tree = createRTree(policy);
+    memset(model, -1, sizeof(model));
+    model_count = 0;
+    test_state = 0x5eed0000 + policy;
+
+    for (int i = 0; i < 6000; i++) {
+        int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+        SensorNode record = {x, y, 50, 10, testRandom(100), NULL};
+        int added = insertOrUpdateSensor(tree, &record);
+        CHECK(added == (model[x][y] < 0), "insert at an %s point returned %d", model[x][y] < 0 ? "empty" : "occupied", added);
+        model_count += model[x][y] < 0;
+        model[x][y] = record.temperature;
+    }
+    snprintf(phase, sizeof(phase), "%s inserts", splitPolicyName(policy));
+    checkAgainstModel(tree, phase);
+
+    // validateRTree checks the aggregates refreshed through each sensor's leaf pointer
+    for (int i = 0; i < 2000; i++) {
+        int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+        SensorNode *sensor = findSensorAt(tree, x, y);
+        if (sensor) {
+            SensorNode record = {x, y, testRandom(100), 10, testRandom(100), NULL};
+            updateSensorReadings(tree, sensor, &record);
+            model[x][y] = record.temperature;
+        }
+    }
+    snprintf(phase, sizeof(phase), "%s updates", splitPolicyName(policy));
+    checkAgainstModel(tree, phase);
+
+    for (int i = 0; i < 3000; i++) {
+        int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+        SensorNode target = {x, y, 0, 0, 0, NULL};
+        int deleted = deleteSensorFromRTree(tree, &target);
+        CHECK(deleted == (model[x][y] >= 0), "delete returned %d", deleted);
+        model_count -= model[x][y] >= 0;
+        model[x][y] = -1;
+    }
+    snprintf(phase, sizeof(phase), "%s deletes", splitPolicyName(policy));
+    checkAgainstModel(tree, phase);
+
+    // The list repeats some points and names others that hold no sensor
+    enum { LIST = 1500 };
+    SensorNode *list = (SensorNode *)malloc(LIST * sizeof(SensorNode));
+    if (!list) {
+        fprintf(stderr, "Memory allocation failed for test records.\n");
+        exit(EXIT_FAILURE);
+    }
+    int expected = 0;
+    for (int i = 0; i < LIST; i++) {
+        int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+        if (i % 10 == 9) {
+            x = (int)list[i / 2].x;
+            y = (int)list[i / 2].y;
+        }
+        SensorNode target = {x, y, 0, 0, 0, NULL};
+        list[i] = target;
+        if (model[x][y] >= 0) {
+            model[x][y] = -1;
+            expected++;
+        }
+    }
+    int deleted = deleteSensorList(tree, list, LIST);
+    CHECK(deleted == expected, "list delete removed %d sensors, expected %d", deleted, expected);
+    CHECK(deleteSensorList(tree, list, 0) == 0, "empty list delete removed sensors");
+    model_count -= expected;
+    free(list);
+    snprintf(phase, sizeof(phase), "%s list deletes", splitPolicyName(policy));
+    checkAgainstModel(tree, phase);
+
+    for (int i = 0; i < 20; i++) {
+        BoundingBox region = randomTestBox();
+        int expected = modelCount(&region);
+        int deleted = deleteSensorsInRegion(tree, &region);
+        CHECK(deleted == expected, "region delete removed %d sensors, expected %d", deleted, expected);
+        for (int x = (int)region.min_x; x <= (int)region.max_x; x++) {
+            for (int y = (int)region.min_y; y <= (int)region.max_y; y++) {
+                model[x][y] = -1;
+            }
+        }
+        model_count -= expected;
+    }
+    snprintf(phase, sizeof(phase), "%s region deletes", splitPolicyName(policy));
+    checkAgainstModel(tree, phase);
+
+    destroyRTree(tree);
+}
+
+// Fill a new tree and the model with count random sensors (fewer if points repeat)
+static RTree *buildTestTree(SplitPolicy policy, int count, uint64_t seed) {
+    RTree *tree = createRTree(policy);
+    memset(model, -1, sizeof(model));
+    model_count = 0;
+    test_state = seed;
+    for (int i = 0; i < count; i++) {
+        int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+        SensorNode record = {x, y, 50, 10, testRandom(100), NULL};
+        model_count += insertOrUpdateSensor(tree, &record);
+        model[x][y] = record.temperature;
+    }
+    return tree;
+}
+
+// Squared distance from (x, y) to a grid point
+static long long gridDistSq(int x, int y, int px, int py) {
+    return (long long)(px - x) * (px - x) + (long long)(py - y) * (py - y);
+}
+
+// Radius queries, with and without a temperature filter, must return exactly the model sensors
+// within the radius. Integer centres and radii put many sensors exactly on the circle.
+static void testRadiusQuery(SplitPolicy policy) {
+    static unsigned char seen[TEST_SIDE][TEST_SIDE];
+    RTree *tree = buildTestTree(policy, 8000, 0x7ad1 + policy);
+    for (int q = 0; q < TEST_QUERIES; q++) {
+        int cx = testRandom(TEST_SIDE + 40) - 20, cy = testRandom(TEST_SIDE + 40) - 20;
+        int radius = q % 10 == 0 ? 0 : testRandom(TEST_SIDE / 8);
+        SensorFilter filter;
+        initSensorFilter(&filter);
+        if (q % 2) {
+            filter.min_temperature = testRandom(50);
+            filter.max_temperature = filter.min_temperature + testRandom(50);
+        }
+
+        int expected = 0;
+        for (int x = cx - radius; x <= cx + radius; x++) {
+            for (int y = cy - radius; y <= cy + radius; y++) {
+                if (x >= 0 && x < TEST_SIDE && y >= 0 && y < TEST_SIDE && model[x][y] >= 0 &&
+                    model[x][y] >= filter.min_temperature && model[x][y] <= filter.max_temperature &&
+                    gridDistSq(cx, cy, x, y) <= (long long)radius * radius) {
+                    expected++;
+                }
+            }
+        }
+
+        QueryCursor cursor;
+        SensorNode *batch[64];
+        int found = 0, wrong = 0, fetched;
+        memset(seen, 0, sizeof(seen));
+        openRadiusCursor(&cursor, tree->root, cx, cy, radius, q % 2 ? &filter : NULL);
+        while ((fetched = fetchRangeResults(&cursor, batch, 64)) > 0) {
+            for (int i = 0; i < fetched; i++) {
+                int x = (int)batch[i]->x, y = (int)batch[i]->y;
+                wrong += seen[x][y]++ || gridDistSq(cx, cy, x, y) > (long long)radius * radius ||
+                         !sensorMatchesFilter(batch[i], &filter);
+            }
+            found += fetched;
+        }
+        CHECK(found == expected && wrong == 0, "%s radius %d query found %d sensors (%d wrong), expected %d",
+              splitPolicyName(policy), radius, found, wrong, expected);
+    }
+    destroyRTree(tree);
+}
+
+// qsort comparator for squared distances
+static int compareDistSq(const void *a, const void *b) {
+    long long left = *(const long long *)a, right = *(const long long *)b;
+    return (left > right) - (left < right);
+}
+
+// Nearest-neighbour searches must return distinct sensors whose distances are the k smallest of
+// a sorted linear scan, within max_distance and the filter. Grid points put many sensors at equal
+// distances, so only the distances are compared; a fixed cross of four sensors checks a tie of k.
+static void testNearestNeighbors(SplitPolicy policy) {
+    static unsigned char seen[TEST_SIDE][TEST_SIDE];
+    enum { QUERIES = 60, MAX_K = 40 };
+    RTree *tree = buildTestTree(policy, 8000, 0x9e1b + policy);
+    long long *distances = (long long *)malloc(TEST_SIDE * TEST_SIDE * sizeof(long long));
+    if (!distances) {
+        fprintf(stderr, "Memory allocation failed for test distances.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int q = 0; q < QUERIES; q++) {
+        int cx = testRandom(TEST_SIDE + 40) - 20, cy = testRandom(TEST_SIDE + 40) - 20;
+        int k = 1 + testRandom(MAX_K);
+        int max_distance = q % 3 == 0 ? testRandom(TEST_SIDE / 16) : -1;
+        SensorFilter filter;
+        initSensorFilter(&filter);
+        if (q % 2) {
+            filter.min_temperature = testRandom(50);
+            filter.max_temperature = filter.min_temperature + testRandom(50);
+        }
+
+        int candidates = 0;
+        for (int x = 0; x < TEST_SIDE; x++) {
+            for (int y = 0; y < TEST_SIDE; y++) {
+                long long dist_sq = gridDistSq(cx, cy, x, y);
+                if (model[x][y] >= 0 && model[x][y] >= filter.min_temperature && model[x][y] <= filter.max_temperature &&
+                    (max_distance < 0 || dist_sq <= (long long)max_distance * max_distance)) {
+                    distances[candidates++] = dist_sq;
+                }
+            }
+        }
+        qsort(distances, candidates, sizeof(long long), compareDistSq);
+
+        NeighborResult results[MAX_K];
+        int found = nearestNeighbors(tree->root, cx, cy, k, max_distance, q % 2 ? &filter : NULL, results);
+        int expected = candidates < k ? candidates : k;
+        int wrong = 0;
+        memset(seen, 0, sizeof(seen));
+        for (int i = 0; i < found && i < expected; i++) {
+            int x = (int)results[i].sensor->x, y = (int)results[i].sensor->y;
+            wrong += seen[x][y]++ || (long long)results[i].dist_sq != distances[i] ||
+                     gridDistSq(cx, cy, x, y) != distances[i] || !sensorMatchesFilter(results[i].sensor, &filter);
+        }
+        CHECK(found == expected && wrong == 0, "%s %d-nearest search found %d sensors (%d wrong), expected %d",
+              splitPolicyName(policy), k, found, wrong, expected);
+    }
+    free(distances);
+    destroyRTree(tree);
+
+    // Four sensors 5 away from (100, 100) and one further out
+    RTree *cross = createRTree(policy);
+    SensorNode records[] = {{103, 104, 0, 0, 0, NULL}, {96, 103, 0, 0, 0, NULL}, {95, 100, 0, 0, 0, NULL},
+                            {104, 97, 0, 0, 0, NULL}, {106, 100, 0, 0, 0, NULL}};
+    for (int i = 0; i < 5; i++) {
+        insertOrUpdateSensor(cross, &records[i]);
+    }
+    NeighborResult ties[5];
+    int found = nearestNeighbors(cross->root, 100, 100, 2, -1, NULL, ties);
+    CHECK(found == 2 && ties[0].dist_sq == 25 && ties[1].dist_sq == 25 && ties[0].sensor != ties[1].sensor,
+          "%s search for 2 of 4 tied sensors failed", splitPolicyName(policy));
+    found = nearestNeighbors(cross->root, 100, 100, 5, 5, NULL, ties);
+    CHECK(found == 4 && ties[3].dist_sq == 25, "%s search within the tie distance found %d sensors",
+          splitPolicyName(policy), found);
+    destroyRTree(cross);
+}
+
+// Filtered range queries must return exactly the model sensors in the box that pass the filter,
+// and hottestSensors the k hottest of them in order of a sorted scan (temperatures tie often)
+static void testFilteredQueries(SplitPolicy policy) {
+    static unsigned char seen[TEST_SIDE][TEST_SIDE];
+    enum { MAX_K = 50 };
+    RTree *tree = buildTestTree(policy, 8000, 0xf117 + policy);
+    for (int q = 0; q < TEST_QUERIES; q++) {
+        BoundingBox box = randomTestBox();
+        SensorFilter filter;
+        initSensorFilter(&filter);
+        filter.min_temperature = testRandom(60);
+        filter.max_temperature = filter.min_temperature + testRandom(60);
+        if (q % 4 == 3) {
+            filter.min_pollution = 11;   // buildTestTree gives every sensor a pollution level of 10
+        }
+
+        // Matching sensors per temperature, so the sorted scan is a walk down the temperatures
+        int per_temperature[100] = {0};
+        int expected = 0;
+        for (int x = (int)box.min_x; x <= (int)box.max_x; x++) {
+            for (int y = (int)box.min_y; y <= (int)box.max_y; y++) {
+                if (model[x][y] >= filter.min_temperature && model[x][y] <= filter.max_temperature && q % 4 != 3) {
+                    per_temperature[model[x][y]]++;
+                    expected++;
+                }
+            }
+        }
+
+        QueryCursor cursor;
+        SensorNode *batch[64];
+        int found = 0, wrong = 0, fetched;
+        memset(seen, 0, sizeof(seen));
+        openFilteredRangeCursor(&cursor, tree->root, &box, &filter);
+        while ((fetched = fetchRangeResults(&cursor, batch, 64)) > 0) {
+            for (int i = 0; i < fetched; i++) {
+                int x = (int)batch[i]->x, y = (int)batch[i]->y;
+                wrong += seen[x][y]++ || x < box.min_x || x > box.max_x || y < box.min_y || y > box.max_y ||
+                         !sensorMatchesFilter(batch[i], &filter);
+            }
+            found += fetched;
+        }
+        CHECK(found == expected && wrong == 0, "%s filtered range query found %d sensors (%d wrong), expected %d",
+              splitPolicyName(policy), found, wrong, expected);
+
+        SensorNode *hottest[MAX_K];
+        int k = 1 + testRandom(MAX_K);
+        int found_hot = hottestSensors(tree->root, &box, k, &filter, hottest);
+        int expected_hot = expected < k ? expected : k;
+        int temperature = 99;
+        wrong = 0;
+        memset(seen, 0, sizeof(seen));
+        for (int i = 0; i < found_hot && i < expected_hot; i++) {
+            while (per_temperature[temperature] == 0) {
+                temperature--;
+            }
+            per_temperature[temperature]--;
+            int x = (int)hottest[i]->x, y = (int)hottest[i]->y;
+            wrong += seen[x][y]++ || hottest[i]->temperature != temperature || x < box.min_x || x > box.max_x ||
+                     y < box.min_y || y > box.max_y || !sensorMatchesFilter(hottest[i], &filter);
+        }
+        CHECK(found_hot == expected_hot && wrong == 0, "%s top-%d search found %d sensors (%d wrong), expected %d",
+              splitPolicyName(policy), k, found_hot, wrong, expected_hot);
+    }
+    destroyRTree(tree);
+}
+
+// A batch of range queries answered in one traversal must return, for each query, exactly
+// the sensors a brute-force scan finds in its box
+static void testMultiRangeQuery(void) {
+    enum { QUERIES = 150 };   // More than one 64-query mask word
+    RTree *tree = buildTestTree(DEFAULT_SPLIT_POLICY, 8000, 0x6006);
+    BoundingBox queries[QUERIES];
+    for (int q = 0; q < QUERIES; q++) {
+        queries[q] = randomTestBox();
+    }
+    queries[QUERIES - 1].min_x = TEST_SIDE + 10;   // Misses the tree entirely
+    queries[QUERIES - 1].max_x = TEST_SIDE + 20;
+
+    MultiQueryResult result;
+    int total = multiRangeQuery(tree->root, queries, QUERIES, &result);
+    int expected_total = 0;
+    CHECK(result.num_queries == QUERIES, "result holds %d queries", result.num_queries);
+    for (int q = 0; q < QUERIES; q++) {
+        int expected = q == QUERIES - 1 ? 0 : modelCount(&queries[q]);
+        int found = result.offsets[q + 1] - result.offsets[q];
+        CHECK(found == expected, "query %d found %d sensors, expected %d", q, found, expected);
+        for (int r = result.offsets[q]; r < result.offsets[q + 1]; r++) {
+            SensorNode *sensor = result.sensors[r];
+            CHECK(sensor->x >= queries[q].min_x && sensor->x <= queries[q].max_x && sensor->y >= queries[q].min_y &&
+                      sensor->y <= queries[q].max_y,
+                  "query %d returned a sensor outside its box", q);
+        }
+        expected_total += expected;
+    }
+    CHECK(total == expected_total && result.num_results == total, "multi-query found %d hits, expected %d", total,
+          expected_total);
+    freeMultiQueryResult(&result);
+    destroyRTree(tree);
+}
+
+// Joining against zones must give, for each zone, exactly the model sensors inside it. The
+// zone sets range from none to several levels of zone tree, with point zones, overlapping
+// zones and one off the grid; an empty tree joins to nothing.
+static void testSpatialJoinZones(void) {
+    static int seen_by[TEST_SIDE][TEST_SIDE];   // Zone number + 1 of the last hit at each point
+    enum { MAX_ZONES = 600 };
+    int zone_counts[] = {0, 1, 7, MAX_ZONES};
+    BoundingBox zones[MAX_ZONES];
+    RTree *tree = buildTestTree(DEFAULT_SPLIT_POLICY, 8000, 0x2e0e);
+    for (int c = 0; c < (int)(sizeof(zone_counts) / sizeof(zone_counts[0])); c++) {
+        int num_zones = zone_counts[c];
+        for (int z = 0; z < num_zones; z++) {
+            zones[z] = randomTestBox();
+            if (z % 5 == 1) {
+                zones[z].max_x = zones[z].min_x;
+                zones[z].max_y = zones[z].min_y;
+            } else if (z % 5 == 2) {
+                zones[z] = zones[z - 1];
+            }
+        }
+        if (num_zones > 2) {
+            zones[2] = (BoundingBox){TEST_SIDE + 5, 0, TEST_SIDE + 50, TEST_SIDE - 1};
+        }
+
+        MultiQueryResult result;
+        int total = spatialJoinZones(tree->root, zones, num_zones, &result);
+        int expected_total = 0, wrong = 0;
+        memset(seen_by, 0, sizeof(seen_by));
+        CHECK(result.num_queries == num_zones, "join result holds %d zones, expected %d", result.num_queries, num_zones);
+        for (int z = 0; z < num_zones; z++) {
+            int expected = z == 2 && num_zones > 2 ? 0 : modelCount(&zones[z]);
+            int found = result.offsets[z + 1] - result.offsets[z];
+            wrong += found != expected;
+            for (int r = result.offsets[z]; r < result.offsets[z + 1]; r++) {
+                SensorNode *sensor = result.sensors[r];
+                int x = (int)sensor->x, y = (int)sensor->y;
+                wrong += seen_by[x][y] == z + 1 || x < zones[z].min_x || x > zones[z].max_x || y < zones[z].min_y ||
+                         y > zones[z].max_y;
+                seen_by[x][y] = z + 1;
+            }
+            expected_total += expected;
+        }
+        CHECK(wrong == 0 && total == expected_total && result.num_results == total,
+              "join with %d zones found %d hits, expected %d (%d wrong)", num_zones, total, expected_total, wrong);
+        freeMultiQueryResult(&result);
+    }
+    destroyRTree(tree);
+
+    RTree *empty = createRTree(DEFAULT_SPLIT_POLICY);
+    MultiQueryResult result;
+    CHECK(spatialJoinZones(empty->root, zones, 7, &result) == 0 && result.num_queries == 7 && result.offsets[7] == 0,
+          "join against an empty tree found hits");
+    freeMultiQueryResult(&result);
+    destroyRTree(empty);
+}
+
+// Join a small tree with a large one, in both orders so the deeper tree is on either side.
+// Each small-tree sensor (numbered by its pollution level) must be paired with exactly the
+// model sensors within distance of it on both axes.
+static void testSpatialJoinTrees(void) {
+    enum { SMALL = 300 };
+    RTree *small = createRTree(DEFAULT_SPLIT_POLICY);
+    SensorNode records[SMALL];
+    test_state = 0x2020;
+    for (int i = 0; i < SMALL; i++) {
+        SensorNode record = {testRandom(TEST_SIDE), testRandom(TEST_SIDE), 50, i, 20, NULL};
+        while (findSensorAt(small, record.x, record.y)) {
+            record.x = testRandom(TEST_SIDE);
+        }
+        records[i] = record;
+        insertOrUpdateSensor(small, &record);
+    }
+    RTree *large = buildTestTree(DEFAULT_SPLIT_POLICY, 20000, 0x2021);
+
+    for (int distance = 0; distance <= 3; distance += 3) {
+        for (int order = 0; order < 2; order++) {
+            SensorPairs pairs;
+            int count = order == 0 ? spatialJoinTrees(small->root, large->root, distance, &pairs)
+                                   : spatialJoinTrees(large->root, small->root, distance, &pairs);
+            int found[SMALL] = {0};
+            for (int p = 0; p < count; p++) {
+                SensorNode *a = order == 0 ? pairs.left[p] : pairs.right[p];
+                SensorNode *b = order == 0 ? pairs.right[p] : pairs.left[p];
+                CHECK(fabs((double)a->x - b->x) <= distance && fabs((double)a->y - b->y) <= distance,
+                      "joined sensors are more than %d apart", distance);
+                found[a->PollutionLevel]++;
+            }
+
+            int wrong = 0, expected_total = 0;
+            for (int i = 0; i < SMALL; i++) {
+                BoundingBox point = createBoundingBoxForSensor(&records[i]);
+                BoundingBox near = growBox(&point, distance);
+                BoundingBox grid = {0, 0, TEST_SIDE - 1, TEST_SIDE - 1};
+                BoundingBox clipped;
+                int expected = intersectBoxes(&near, &grid, &clipped) ? modelCount(&clipped) : 0;
+                wrong += found[i] != expected;
+                expected_total += expected;
+            }
+            CHECK(wrong == 0 && count == expected_total, "distance %d join found %d pairs, expected %d (%d sensors differ)",
+                  distance, count, expected_total, wrong);
+            freeSensorPairs(&pairs);
+        }
+    }
+    destroyRTree(large);
+    destroyRTree(small);
+}
+
+// Rasterizing a tree must give each cell the count, temperature sum and maximum of the sensors
+// in it: first a 2 x 2 grid over a hand-placed tree with sensors on every cell edge and one off
+// the extent, then a coarse grid over part of a large tree, where whole subtrees fall into one
+// cell and are added from their aggregates
+static void testRasterize(void) {
+    RTree *tiny = createRTree(DEFAULT_SPLIT_POLICY);
+    SensorNode records[] = {{0, 0, 0, 0, 10, NULL}, {4, 4, 0, 0, 20, NULL}, {5, 0, 0, 0, 30, NULL}, {9, 9, 0, 0, 40, NULL},
+                            {5, 9, 0, 0, 5, NULL},  {4, 9, 0, 0, 7, NULL},  {10, 10, 0, 0, 99, NULL}};
+    for (int i = 0; i < 7; i++) {
+        insertOrUpdateSensor(tiny, &records[i]);
+    }
+    BoundingBox extent = {0, 0, 9, 9};
+    Raster raster;
+    initRaster(&raster, &extent, 2, 2);
+    rasterizeTree(&raster, tiny->root);
+    long long counts[] = {2, 1, 1, 2}, sums[] = {30, 30, 7, 45};   // Cells in row-major order from the bottom left
+    int maxima[] = {20, 30, 7, 40};
+    for (int c = 0; c < 4; c++) {
+        CHECK(raster.count[c] == counts[c] && raster.sum[c] == sums[c] && raster.max[c] == maxima[c],
+              "tiny raster cell %d holds %lld sensors, sum %lld, max %d", c, raster.count[c], raster.sum[c], raster.max[c]);
+    }
+    freeRaster(&raster);
+    destroyRTree(tiny);
+
+    enum { COLUMNS = 7, ROWS = 5 };
+    RTree *tree = buildTestTree(DEFAULT_SPLIT_POLICY, 20000, 0x4a57);
+    extent = (BoundingBox){37, 50, 400, 300};
+    initRaster(&raster, &extent, COLUMNS, ROWS);   // Its cell mapping was checked on the tiny grid
+    long long count[ROWS][COLUMNS] = {{0}}, sum[ROWS][COLUMNS] = {{0}};
+    int max[ROWS][COLUMNS];
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLUMNS; c++) {
+            max[r][c] = INT_MIN;
+        }
+    }
+    for (int x = 37; x <= 400; x++) {
+        for (int y = 50; y <= 300; y++) {
+            if (model[x][y] >= 0) {
+                int c = rasterColumn(&raster, x), r = rasterRow(&raster, y);
+                count[r][c]++;
+                sum[r][c] += model[x][y];
+                max[r][c] = model[x][y] > max[r][c] ? model[x][y] : max[r][c];
+            }
+        }
+    }
+    rasterizeTree(&raster, tree->root);
+    int wrong = 0;
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLUMNS; c++) {
+            size_t cell = (size_t)r * COLUMNS + c;
+            wrong += raster.count[cell] != count[r][c] || raster.sum[cell] != sum[r][c] || raster.max[cell] != max[r][c];
+        }
+    }
+    CHECK(wrong == 0, "%d of %d raster cells differ from a scan", wrong, COLUMNS * ROWS);
+    freeRaster(&raster);
+    destroyRTree(tree);
+}
+
+// Bulk loads of several sizes (empty, one node, one past a node, many levels) must give valid
+// trees that agree with the model, and keep doing so through inserts and deletes afterwards
+static void testBulkLoad(void) {
+    int sizes[] = {0, 1, MAX_ENTRIES, MAX_ENTRIES + 1, 20000};
+    SensorNode *records = (SensorNode *)malloc(20000 * sizeof(SensorNode));
+    if (!records) {
+        fprintf(stderr, "Memory allocation failed for test records.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        char phase[64];
+        memset(model, -1, sizeof(model));
+        model_count = 0;
+        test_state = 0xb01d + s;
+        for (int i = 0; i < sizes[s]; i++) {
+            int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+            SensorNode record = {x, y, 50, 10, testRandom(100), NULL};
+            records[i] = record;
+            model_count += model[x][y] < 0;
+            model[x][y] = record.temperature;   // The last row for a point wins
+        }
+        RTree *tree = createRTreeFromRecords(records, sizes[s]);
+        snprintf(phase, sizeof(phase), "bulk load of %d rows", sizes[s]);
+        checkAgainstModel(tree, phase);
+
+        for (int i = 0; i < 2000; i++) {
+            int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+            if (i % 2) {
+                SensorNode record = {x, y, 50, 10, testRandom(100), NULL};
+                model_count += insertOrUpdateSensor(tree, &record);
+                model[x][y] = record.temperature;
+            } else {
+                SensorNode target = {x, y, 0, 0, 0, NULL};
+                model_count -= deleteSensorFromRTree(tree, &target);
+                model[x][y] = -1;
+            }
+        }
+        snprintf(phase, sizeof(phase), "changes after a bulk load of %d rows", sizes[s]);
+        checkAgainstModel(tree, phase);
+        destroyRTree(tree);
+    }
+    free(records);
+}
+
+// Bulk loads keep one sensor per point, with the readings of the last row for it
+static void testBulkLoadDuplicates(void) {
+    SensorNode records[] = {{1, 1, 0, 0, 1, NULL}, {1, 1, 0, 0, 2, NULL}, {2, 2, 0, 0, 3, NULL}, {1, 1, 0, 0, 4, NULL}};
+    RTree *tree = createRTreeFromRecords(records, 4);
+    CHECK(tree->index.count == 2, "bulk load of 2 distinct points holds %zu sensors", tree->index.count);
+    CHECK(findSensorAt(tree, 1, 1) && findSensorAt(tree, 1, 1)->temperature == 4, "last duplicate row was not kept");
+    CHECK(validateRTree(tree) == 0, "bulk load with duplicates is not valid");
+    destroyRTree(tree);
+}
+
+// Shared by the reader threads of testConcurrentReadersAndWriter. Readers query the left half
+// of the grid, which the writer never touches, and the right half, which it keeps changing.
+typedef struct ConcurrentTestState {
+    ConcurrentRTree *ctree;
+    int left_count;           // Sensors in the left half, fixed for the whole test
+    atomic_int writer_done;
+    atomic_int reader_errors;
+} ConcurrentTestState;
+
+// Reader thread: the left half must always hold the same sensors, and every sensor read in the
+// right half must be a consistent copy (the writer gives each one a temperature of x + y)
+static void *concurrentTestReader(void *arg) {
+    ConcurrentTestState *state = (ConcurrentTestState *)arg;
+    BoundingBox left = {0, 0, TEST_SIDE / 2 - 1, TEST_SIDE - 1};
+    BoundingBox right = {TEST_SIDE / 2, 0, TEST_SIDE - 1, TEST_SIDE - 1};
+    SensorNode *results = (SensorNode *)malloc(TEST_SIDE * TEST_SIDE / 2 * sizeof(SensorNode));
+    if (!results) {
+        fprintf(stderr, "Memory allocation failed for test results.\n");
+        exit(EXIT_FAILURE);
+    }
+    while (!atomic_load(&state->writer_done)) {
+        SensorAggregate aggregate;
+        if (concurrentRangeQuery(state->ctree, &left, results, TEST_SIDE * TEST_SIDE / 2) != state->left_count ||
+            concurrentRegionAggregate(state->ctree, &left, &aggregate) != state->left_count) {
+            atomic_fetch_add(&state->reader_errors, 1);
+        }
+        int found = concurrentRangeQuery(state->ctree, &right, results, TEST_SIDE * TEST_SIDE / 2);
+        for (int i = 0; i < found; i++) {
+            if (results[i].temperature != (int)(results[i].x + results[i].y)) {
+                atomic_fetch_add(&state->reader_errors, 1);
+            }
+        }
+    }
+    free(results);
+    return NULL;
+}
+
+// Readers query a ConcurrentRTree while a writer inserts, updates and deletes sensors; afterwards
+// both instances must be valid and agree with the model
+static void testConcurrentReadersAndWriter(void) {
+    enum { READERS = 4, INITIAL = 4000, WRITES = 3000 };
+    SensorNode *records = (SensorNode *)malloc(INITIAL * sizeof(SensorNode));
+    if (!records) {
+        fprintf(stderr, "Memory allocation failed for test records.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(model, -1, sizeof(model));
+    model_count = 0;
+    test_state = 0xc0c0;
+    ConcurrentTestState state;
+    state.left_count = 0;
+    for (int i = 0; i < INITIAL; i++) {
+        int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+        SensorNode record = {x, y, 50, 10, x + y, NULL};
+        records[i] = record;
+        if (model[x][y] < 0) {
+            model_count++;
+            state.left_count += x < TEST_SIDE / 2;
+        }
+        model[x][y] = x + y;
+    }
+    state.ctree = createConcurrentRTree(records, INITIAL);
+    free(records);
+    atomic_init(&state.writer_done, 0);
+    atomic_init(&state.reader_errors, 0);
+
+    pthread_t readers[READERS];
+    for (int i = 0; i < READERS; i++) {
+        pthread_create(&readers[i], NULL, concurrentTestReader, &state);
+    }
+    for (int i = 0; i < WRITES; i++) {
+        int x = TEST_SIDE / 2 + testRandom(TEST_SIDE / 2), y = testRandom(TEST_SIDE);
+        SensorNode record = {x, y, 50 + i % 7, 10, x + y, NULL};
+        switch (i % 3) {
+        case 0:
+            concurrentInsertSensor(state.ctree, &record);
+            model_count += model[x][y] < 0;
+            model[x][y] = x + y;
+            break;
+        case 1:
+            concurrentUpdateSensor(state.ctree, &record);
+            break;
+        default:
+            concurrentDeleteSensor(state.ctree, x, y);
+            model_count -= model[x][y] >= 0;
+            model[x][y] = -1;
+            break;
+        }
+    }
+    atomic_store(&state.writer_done, 1);
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    CHECK(atomic_load(&state.reader_errors) == 0, "readers saw %d inconsistent results", atomic_load(&state.reader_errors));
+    checkAgainstModel(state.ctree->instances[0], "concurrent instance 0");
+    checkAgainstModel(state.ctree->instances[1], "concurrent instance 1");
+    destroyConcurrentRTree(state.ctree);
+}
+
+// A sensor deleted and inserted again has no history for the timesteps it was missing:
+// sensorHistoryAt finds nothing there and historyExceedances does not see its old readings
+static void testHistoryGaps(void) {
+    RTree *tree = createRTree(DEFAULT_SPLIT_POLICY);
+    SensorNode steady = {10, 10, 40, 5, 20, NULL};
+    SensorNode moved = {20, 20, 40, 5, 95, NULL};
+    insertOrUpdateSensor(tree, &steady);
+    insertOrUpdateSensor(tree, &moved);
+    enableSensorHistory(tree);                 // Timestep 1
+    recordHistoryStep(tree);                   // Timestep 2
+    deleteSensorFromRTree(tree, &moved);
+    for (int step = 3; step <= 40; step++) {   // Gaps for timesteps 3 to 40, across several buckets
+        recordHistoryStep(tree);
+    }
+    moved.temperature = 30;
+    insertOrUpdateSensor(tree, &moved);
+    recordHistoryStep(tree);                   // Timestep 41
+
+    SensorNode sample;
+    CHECK(sensorHistoryAt(tree, 20, 20, 2, &sample) && sample.temperature == 95, "sample before the gap was lost");
+    CHECK(!sensorHistoryAt(tree, 20, 20, 3, &sample), "timestep 3 of a deleted sensor has a sample");
+    CHECK(!sensorHistoryAt(tree, 20, 20, 33, &sample), "timestep 33 of a deleted sensor has a sample");
+    CHECK(sensorHistoryAt(tree, 20, 20, 41, &sample) && sample.temperature == 30, "sample after the gap was lost");
+    CHECK(sensorHistoryAt(tree, 10, 10, 33, &sample) && sample.temperature == 20, "steady sensor lost a sample");
+    CHECK(!sensorHistoryAt(tree, 10, 10, 42, &sample), "timestep after the last one has a sample");
+
+    BoundingBox all = {0, 0, 100, 100};
+    SensorNode *results[2];
+    CHECK(historyExceedances(tree, &all, 90, 3, 41, results, 2) == 0, "a gap repeated the readings before it");
+    CHECK(historyExceedances(tree, &all, 90, 1, 41, results, 2) == 1 && results[0]->x == 20,
+          "exceedance before the gap was missed");
+    CHECK(historyExceedances(tree, &all, 25, 17, 40, results, 2) == 0, "a bucket of gaps was counted");
+    destroyRTree(tree);
+}
+
+// Readings that jump between the ends of the int range round-trip through the delta-encoded
+// history, and exceedance searches decode them correctly
+static void testHistoryExtremes(void) {
+    static const int readings[] = {INT_MIN, INT_MAX, INT_MIN, 0, INT_MAX, -1, INT_MIN + 1, INT_MAX - 1};
+    enum { STEPS = 40 };   // Crosses several history buckets
+    RTree *tree = createRTree(DEFAULT_SPLIT_POLICY);
+    SensorNode sensor = {7, 7, INT_MAX, INT_MIN, INT_MIN, NULL};
+    insertOrUpdateSensor(tree, &sensor);
+    enableSensorHistory(tree);   // Timestep 1
+    for (int step = 2; step <= STEPS; step++) {
+        SensorNode record = {7, 7, readings[step % 8], readings[(step + 3) % 8], readings[step % 8], NULL};
+        updateSensorReadings(tree, findSensorAt(tree, 7, 7), &record);
+        recordHistoryStep(tree);
+    }
+
+    int wrong = 0;
+    SensorNode sample;
+    for (int step = 1; step <= STEPS; step++) {
+        int humidity = step == 1 ? INT_MAX : readings[step % 8];
+        int pollution = step == 1 ? INT_MIN : readings[(step + 3) % 8];
+        int temperature = step == 1 ? INT_MIN : readings[step % 8];
+        wrong += !sensorHistoryAt(tree, 7, 7, step, &sample) || sample.humidity != humidity ||
+                 sample.PollutionLevel != pollution || sample.temperature != temperature;
+    }
+    CHECK(wrong == 0, "%d of %d extreme samples did not round-trip", wrong, STEPS);
+
+    // INT_MAX is reached where step % 8 is 1 or 4 (steps 4, 9, 12, ...); INT_MAX - 1 at step 7
+    BoundingBox all = {0, 0, 10, 10};
+    SensorNode *results[1];
+    CHECK(historyExceedances(tree, &all, INT_MAX - 1, 5, 8, results, 1) == 0, "steps 5 to 8 exceeded INT_MAX - 1");
+    CHECK(historyExceedances(tree, &all, INT_MAX - 1, 5, 9, results, 1) == 1, "INT_MAX at step 9 was missed");
+    CHECK(historyExceedances(tree, &all, INT_MAX - 2, 5, 8, results, 1) == 1, "INT_MAX - 1 at step 7 was missed");
+    CHECK(historyExceedances(tree, &all, INT_MAX, 1, STEPS, results, 1) == 0, "a reading exceeded INT_MAX");
+    destroyRTree(tree);
+}
+
+// Events stop for a removed standing query and keep coming for the others
+static void testRemoveStandingQuery(void) {
+    RTree *tree = createRTree(DEFAULT_SPLIT_POLICY);
+    BoundingBox wide = {0, 0, 100, 100};
+    BoundingBox narrow = {0, 0, 10, 10};
+    int wide_id = addStandingQuery(tree, &wide, 0, 0);
+    int narrow_id = addStandingQuery(tree, &narrow, 0, 0);
+    StandingEvent events[8];
+    CHECK(fetchStandingEvents(tree, events, 8) == 0, "zones with no changes produced events");
+
+    SensorNode inside_both = {5, 5, 40, 5, 20, NULL};
+    insertOrUpdateSensor(tree, &inside_both);
+    CHECK(fetchStandingEvents(tree, events, 8) == 2, "insert into two zones did not produce two events");
+
+    CHECK(removeStandingQuery(tree, wide_id) == 1, "removing an active zone failed");
+    CHECK(removeStandingQuery(tree, wide_id) == 0, "removing a zone twice succeeded");
+    CHECK(removeStandingQuery(tree, 99) == 0 && removeStandingQuery(tree, -1) == 0, "removing an unknown zone succeeded");
+
+    SensorNode inside_wide = {50, 50, 40, 5, 20, NULL};
+    SensorNode inside_narrow = {6, 6, 40, 5, 20, NULL};
+    insertOrUpdateSensor(tree, &inside_wide);
+    CHECK(fetchStandingEvents(tree, events, 8) == 0, "a removed zone still produced an event");
+    insertOrUpdateSensor(tree, &inside_narrow);
+    CHECK(fetchStandingEvents(tree, events, 8) == 1 && events[0].query_id == narrow_id,
+          "the remaining zone stopped producing events");
+    destroyRTree(tree);
+}
+
+// Send stderr to a file until restoreStderr, so expected error messages can be checked;
+// returns the descriptor to restore
+static int redirectStderr(const char *path) {
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (saved < 0 || fd < 0 || dup2(fd, STDERR_FILENO) < 0) {
+        fprintf(stderr, "Could not redirect stderr to %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+    return saved;
+}
+
+// Undo redirectStderr
+static void restoreStderr(int saved) {
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+}
+
+// Rows kept by testSensorFileParsing, with the line each is on
+typedef struct ExpectedRow {
+    SensorNode record;
+    long line;
+} ExpectedRow;
+
+// A sensor file with blank lines, CRLF endings, malformed rows (missing, extra, non-numeric and
+// out-of-range fields), a line longer than a read chunk, enough rows to cross chunk boundaries
+// and no final newline. The reader must return exactly the valid rows, each with its line
+// number, and count the skipped ones; loadSensorFile must build a valid tree of them.
+static void testSensorFileParsing(void) {
+    enum { ROWS = 120000, MAX_EXPECTED = ROWS + 16, MAX_MALFORMED = 32 };
+    static const char *header[] = {"1 600 3 4 5", "", "1 601 3 4", "  2\t600 8 9 10 \r", "x 601 2 3 4",
+                                   "3 600 1 2 99999999999", "4 600 1 2 3 4", "-5 600 -5 6 -7", "\r"};
+    char path[] = "/tmp/rtree_test_XXXXXX";
+    char log_path[] = "/tmp/rtree_test_XXXXXX";
+    int log_fd = mkstemp(log_path);
+    int fd = mkstemp(path);
+    FILE *file = fd >= 0 && log_fd >= 0 ? fdopen(fd, "w") : NULL;
+    ExpectedRow *expected = (ExpectedRow *)malloc(MAX_EXPECTED * sizeof(ExpectedRow));
+    if (!file || !expected) {
+        fprintf(stderr, "Could not create a temporary sensor file.\n");
+        exit(EXIT_FAILURE);
+    }
+    close(log_fd);
+
+    int num_expected = 0, malformed = 0;
+    long line = 0, malformed_lines[MAX_MALFORMED] = {3, 5, 6, 7};
+    for (int i = 0; i < (int)(sizeof(header) / sizeof(header[0])); i++) {
+        fprintf(file, "%s\n", header[i]);
+        line++;
+    }
+    SensorNode header_rows[] = {{1, 600, 3, 4, 5, NULL}, {2, 600, 8, 9, 10, NULL}, {-5, 600, -5, 6, -7, NULL}};
+    long header_lines[] = {1, 4, 8};
+    for (int i = 0; i < 3; i++) {
+        expected[num_expected].record = header_rows[i];
+        expected[num_expected++].line = header_lines[i];
+    }
+    malformed += 4;
+
+    for (int i = 0; i < ROWS; i++) {
+        line++;
+        if (i % 10007 == 5000) {
+            fprintf(file, "%d %d %d\n", i, i, i);
+            malformed_lines[malformed++] = line;
+            continue;
+        }
+        SensorNode record = {i % TEST_SIDE, i / TEST_SIDE, i % 100, i % 7, i % 50, NULL};
+        fprintf(file, "%d %d %d %d %d\n", i % TEST_SIDE, i / TEST_SIDE, i % 100, i % 7, i % 50);
+        expected[num_expected].record = record;
+        expected[num_expected++].line = line;
+    }
+
+    // A row led by more blanks than one read chunk holds, then a last row without a newline
+    for (int i = 0; i < READER_CHUNK_SIZE + 100; i++) {
+        fputc(' ', file);
+    }
+    fprintf(file, "7 600 1 1 1\n8 600 2 2 2");
+    SensorNode tail_rows[] = {{7, 600, 1, 1, 1, NULL}, {8, 600, 2, 2, 2, NULL}};
+    for (int i = 0; i < 2; i++) {
+        expected[num_expected].record = tail_rows[i];
+        expected[num_expected++].line = ++line;
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Could not write the temporary sensor file.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    SensorReader reader;
+    SensorNode record;
+    int read = 0, wrong = 0;
+    CHECK(openSensorReader(&reader, path) == 0, "sensor file could not be opened");
+    int saved_stderr = redirectStderr(log_path);
+    while (readSensorRecord(&reader, &record)) {
+        if (read < num_expected) {
+            ExpectedRow *row = &expected[read];
+            wrong += record.x != row->record.x || record.y != row->record.y || record.humidity != row->record.humidity ||
+                     record.PollutionLevel != row->record.PollutionLevel ||
+                     record.temperature != row->record.temperature || reader.line != row->line;
+        }
+        read++;
+    }
+    restoreStderr(saved_stderr);
+    CHECK(read == num_expected && wrong == 0, "reader returned %d rows (%d wrong), expected %d", read, wrong,
+          num_expected);
+    CHECK(reader.errors == malformed && reader.line == line, "reader skipped %ld rows over %ld lines, expected %d over %ld",
+          reader.errors, reader.line, malformed, line);
+    closeSensorReader(&reader);
+
+    // Each skipped row is reported once, with its own line number
+    FILE *log = fopen(log_path, "r");
+    char message[512];
+    int reported = 0;
+    wrong = 0;
+    while (log && fgets(message, sizeof(message), log)) {
+        char *position = strstr(message, path);
+        long reported_line = position ? strtol(position + strlen(path) + 1, NULL, 10) : -1;
+        wrong += reported >= malformed || reported_line != malformed_lines[reported];
+        reported++;
+    }
+    if (log) {
+        fclose(log);
+    }
+    CHECK(reported == malformed && wrong == 0, "%d malformed rows reported (%d at a wrong line), expected %d", reported,
+          wrong, malformed);
+
+    saved_stderr = redirectStderr(log_path);
+    RTree *tree = loadSensorFile(path, DEFAULT_SPLIT_POLICY);
+    CHECK(tree != NULL, "sensor file could not be loaded");
+    restoreStderr(saved_stderr);
+    if (tree) {
+        CHECK(tree->index.count == (size_t)num_expected, "loaded tree holds %zu sensors, expected %d", tree->index.count,
+              num_expected);
+        CHECK(validateRTree(tree) == 0, "loaded tree is not valid");
+        SensorNode *sensor = findSensorAt(tree, 2, 600);
+        CHECK(sensor && sensor->temperature == 10, "row with CRLF ending and tab was not loaded");
+        destroyRTree(tree);
+    }
+    saved_stderr = redirectStderr(log_path);
+    RTree *missing = loadSensorFile("/nonexistent/sensors.txt", DEFAULT_SPLIT_POLICY);
+    restoreStderr(saved_stderr);
+    CHECK(missing == NULL, "missing file was loaded");
+    free(expected);
+    unlink(log_path);
+    unlink(path);
+}
+
+// Read a whole file into memory; *size receives its length
+static unsigned char *readTestFile(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Could not open test file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    rewind(file);
+    unsigned char *bytes = (unsigned char *)malloc(*size > 0 ? *size : 1);
+    if (!bytes || fread(bytes, 1, *size, file) != *size) {
+        fprintf(stderr, "Could not read test file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    return bytes;
+}
+
+// Replace a file with size bytes
+static void writeTestFile(const char *path, const unsigned char *bytes, size_t size) {
+    FILE *file = fopen(path, "wb");
+    if (!file || fwrite(bytes, 1, size, file) != size || fclose(file) != 0) {
+        fprintf(stderr, "Could not write test file %s.\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Recompute every checksum of a snapshot image, as a writer of a crafted file would
+static void resealSnapshot(unsigned char *bytes) {
+    SnapshotHeader *header = (SnapshotHeader *)bytes;
+    header->node_checksum = snapshotSectionChecksum(SNAPSHOT_FNV_BASIS, bytes + header->node_offset,
+                                                    header->node_count * header->node_size);
+    header->sensor_checksum = snapshotSectionChecksum(SNAPSHOT_FNV_BASIS, bytes + header->sensor_offset,
+                                                      header->sensor_count * header->sensor_size);
+    header->index_checksum = snapshotSectionChecksum(SNAPSHOT_FNV_BASIS, bytes + header->index_offset,
+                                                     header->index_capacity * sizeof(uint64_t));
+    header->checksum = snapshotChecksum(header);
+}
+
+// Save a tree, map it back and compare it with the model, then check that damaged copies
+// of the file are refused instead of loaded
+static void testSnapshotRoundTrip(void) {
+    char path[] = "/tmp/rtree_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "Could not create a temporary snapshot file.\n");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    RTree *tree = buildTestTree(DEFAULT_SPLIT_POLICY, 6000, 0x5a5a);
+    CHECK(saveRTreeSnapshot(tree, path) == 0, "snapshot could not be saved");
+    destroyRTree(tree);
+    RTree *loaded = loadRTreeSnapshot(path);
+    CHECK(loaded != NULL, "snapshot could not be loaded");
+    if (loaded) {
+        checkAgainstModel(loaded, "snapshot load");
+        for (int i = 0; i < 1000; i++) {
+            int x = testRandom(TEST_SIDE), y = testRandom(TEST_SIDE);
+            SensorNode record = {x, y, 50, 10, testRandom(100), NULL};
+            model_count += insertOrUpdateSensor(loaded, &record);
+            model[x][y] = record.temperature;
+        }
+        checkAgainstModel(loaded, "inserts into a loaded snapshot");
+        destroyRTree(loaded);
+    }
+
+    size_t size;
+    unsigned char *original = readTestFile(path, &size);
+    unsigned char *damaged = (unsigned char *)malloc(size);
+    if (!damaged) {
+        fprintf(stderr, "Memory allocation failed for test snapshot.\n");
+        exit(EXIT_FAILURE);
+    }
+    SnapshotHeader *header = (SnapshotHeader *)damaged;
+
+    writeTestFile(path, original, size - SNAPSHOT_PAGE_SIZE);
+    CHECK(loadRTreeSnapshot(path) == NULL, "truncated snapshot was loaded");
+
+    memcpy(damaged, original, size);
+    damaged[size / 2] ^= 0x10;
+    writeTestFile(path, damaged, size);
+    CHECK(loadRTreeSnapshot(path) == NULL, "snapshot with a flipped byte was loaded");
+
+    memcpy(damaged, original, size);
+    header->version = SNAPSHOT_VERSION + 1;
+    resealSnapshot(damaged);
+    writeTestFile(path, damaged, size);
+    CHECK(loadRTreeSnapshot(path) == NULL, "snapshot with an unknown version was loaded");
+
+    // The root is the first node and, with this many sensors, an internal one
+    memcpy(damaged, original, size);
+    RTreeNode *root = (RTreeNode *)(damaged + header->node_offset);
+    CHECK(!root->is_leaf, "test snapshot root is a leaf");
+    root->children[0] = (RTreeNode *)(uintptr_t)(header->file_size + header->node_size);
+    resealSnapshot(damaged);
+    writeTestFile(path, damaged, size);
+    CHECK(loadRTreeSnapshot(path) == NULL, "snapshot with an out-of-range child offset was loaded");
+
+    // A child that points back at its parent would make every traversal loop forever
+    memcpy(damaged, original, size);
+    root->children[0] = (RTreeNode *)(uintptr_t)header->node_offset;
+    resealSnapshot(damaged);
+    writeTestFile(path, damaged, size);
+    CHECK(loadRTreeSnapshot(path) == NULL, "snapshot with a cyclic child offset was loaded");
+
+    free(damaged);
+    free(original);
+    unlink(path);
+}
+
+// An UPDATE request applies a dataset file to the served sensors and reports how many it
+// changed; later requests see the new readings, and a missing file is an error
+static void testServerUpdate(void) {
+    char data_path[] = "/tmp/rtree_test_XXXXXX";
+    char request_path[] = "/tmp/rtree_test_XXXXXX";
+    char response_path[] = "/tmp/rtree_test_XXXXXX";
+    int data_fd = mkstemp(data_path), request_fd = mkstemp(request_path), response_fd = mkstemp(response_path);
+    if (data_fd < 0 || request_fd < 0 || response_fd < 0) {
+        fprintf(stderr, "Could not create temporary server files.\n");
+        exit(EXIT_FAILURE);
+    }
+    const char *data = "1 1 30 3 60\n2 2 31 4 61\n9 9 32 5 62\n";   // (9, 9) is not served
+    char requests[512];
+    int length = snprintf(requests, sizeof(requests), "UPDATE %s\nRANGE 0 0 1 1\nUPDATE /nonexistent/sensors.txt\nUPDATE\n",
+                          data_path);
+    writeTestFile(data_path, (const unsigned char *)data, strlen(data));
+    writeTestFile(request_path, (const unsigned char *)requests, (size_t)length);
+    close(data_fd);
+
+    SensorNode served[] = {{1, 1, 10, 1, 20, NULL}, {2, 2, 10, 1, 20, NULL}};
+    ConcurrentRTree *ctree = createConcurrentRTree(served, 2);
+    serveConnection(ctree, request_fd, response_fd);
+    close(request_fd);
+    close(response_fd);
+
+    size_t size;
+    unsigned char *responses = readTestFile(response_path, &size);
+    const char *expected = "OK 2\n1 1 30 3 60\nOK 1\nERR could not open sensor file /nonexistent/sensors.txt\n"
+                           "ERR usage: UPDATE sensor_file\n";
+    CHECK(size == strlen(expected) && memcmp(responses, expected, size) == 0, "server responses were:\n%.*s", (int)size,
+          (const char *)responses);
+    for (int i = 0; i < 2; i++) {
+        RTree *tree = ctree->instances[i];
+        CHECK(findSensorAt(tree, 2, 2)->temperature == 61 && findSensorAt(tree, 9, 9) == NULL,
+              "UPDATE did not apply the file to the served sensors of instance %d only", i);
+    }
+    free(responses);
+    destroyConcurrentRTree(ctree);
+    unlink(data_path);
+    unlink(request_path);
+    unlink(response_path);
+}
+
+// Socket server state shared with the thread running serveUnixSocket
+typedef struct SocketTestServer {
+    ConcurrentRTree *ctree;
+    const char *path;
+    int status;
+} SocketTestServer;
+
+static void *socketTestServer(void *arg) {
+    SocketTestServer *server = (SocketTestServer *)arg;
+    server->status = serveUnixSocket(server->ctree, server->path);
+    return NULL;
+}
+
+// Connect to the test server, retrying while it starts listening
+static int connectTestClient(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    struct timespec pause = {0, 10000000};
+    for (int attempt = 0; attempt < 500; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+            return fd;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        nanosleep(&pause, NULL);
+    }
+    fprintf(stderr, "Could not connect to the test server at %s.\n", path);
+    exit(EXIT_FAILURE);
+}
+
+// Send one request and read its response up to and including the status line
+static void exchangeTestRequest(int fd, const char *request, char *response, size_t size) {
+    if (write(fd, request, strlen(request)) != (ssize_t)strlen(request)) {
+        fprintf(stderr, "Could not send a test request.\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t length = 0;
+    while (length + 1 < size) {
+        ssize_t n = read(fd, response + length, size - 1 - length);
+        if (n <= 0) {
+            break;
+        }
+        length += (size_t)n;
+        if (response[length - 1] != '\n') {
+            continue;
+        }
+        char *line = response + length - 1;
+        while (line > response && line[-1] != '\n') {
+            line--;
+        }
+        if (strncmp(line, "OK", 2) == 0 || strncmp(line, "ERR", 3) == 0) {
+            break;
+        }
+    }
+    response[length] = '\0';
+}
+
+// Two socket clients are served at once: one stays connected while the other writes, and
+// sees its insert and the snapshot it loads straight away. SHUTDOWN from one ends the other's
+// connection and the server.
+static void testSocketServer(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/rtree_test_%ld.sock", (long)getpid());
+    SensorNode served[] = {{1, 1, 10, 1, 20, NULL}};
+    SocketTestServer server = {createConcurrentRTree(served, 1), path, -1};
+    pthread_t thread;
+    pthread_create(&thread, NULL, socketTestServer, &server);
+
+    char response[256];
+    int reader = connectTestClient(path);
+    exchangeTestRequest(reader, "RANGE 0 0 5 5\n", response, sizeof(response));
+    CHECK(strcmp(response, "1 1 10 1 20\nOK 1\n") == 0, "first client got %s", response);
+    int writer = connectTestClient(path);
+    exchangeTestRequest(writer, "INSERT 3 3 11 2 30\n", response, sizeof(response));
+    CHECK(strcmp(response, "OK 1\n") == 0, "second client got %s while the first was connected", response);
+    exchangeTestRequest(reader, "KNN 3 3 1\n", response, sizeof(response));
+    CHECK(strcmp(response, "3 3 11 2 30\nOK 1\n") == 0, "first client did not see the insert: %s", response);
+
+    // LOAD swaps a snapshot into both instances under the connected reader
+    char snapshot_path[] = "/tmp/rtree_test_XXXXXX";
+    int snapshot_fd = mkstemp(snapshot_path);
+    RTree *snapshot = buildTestTree(DEFAULT_SPLIT_POLICY, 3000, 0x50c4);
+    char request[128];
+    CHECK(snapshot_fd >= 0 && saveRTreeSnapshot(snapshot, snapshot_path) == 0, "test snapshot could not be saved");
+    snprintf(request, sizeof(request), "LOAD %s\n", snapshot_path);
+    exchangeTestRequest(writer, request, response, sizeof(response));
+    snprintf(request, sizeof(request), "OK %zu\n", snapshot->index.count);
+    CHECK(strcmp(response, request) == 0, "LOAD got %s", response);
+    exchangeTestRequest(reader, "RANGE 3 3 3 3\n", response, sizeof(response));
+    if (model[3][3] >= 0) {
+        snprintf(request, sizeof(request), "3 3 50 10 %d\nOK 1\n", model[3][3]);
+    } else {
+        snprintf(request, sizeof(request), "OK 0\n");
+    }
+    CHECK(strcmp(response, request) == 0, "reader did not see the loaded snapshot: %s", response);
+    size_t loaded_count = snapshot->index.count;
+    destroyRTree(snapshot);
+    close(snapshot_fd);
+    unlink(snapshot_path);
+
+    exchangeTestRequest(writer, "SHUTDOWN\n", response, sizeof(response));
+    CHECK(strcmp(response, "OK 0\n") == 0, "SHUTDOWN got %s", response);
+    CHECK(read(reader, response, sizeof(response)) == 0, "the other client stayed connected after SHUTDOWN");
+    close(reader);
+    close(writer);
+
+    pthread_join(thread, NULL);
+    CHECK(server.status == EXIT_SUCCESS, "server ended with status %d", server.status);
+    for (int i = 0; i < 2; i++) {
+        CHECK(server.ctree->instances[i]->index.count == loaded_count && validateRTree(server.ctree->instances[i]) == 0,
+              "instance %d of the served tree is wrong after the clients", i);
+    }
+    destroyConcurrentRTree(server.ctree);
+}
+
+int main(void) {
+    testRandomOperations(SPLIT_LINEAR);
+    testRandomOperations(SPLIT_QUADRATIC);
+    testRandomOperations(SPLIT_RSTAR);
+    testBulkLoad();
+    testBulkLoadDuplicates();
+    testRadiusQuery(SPLIT_LINEAR);
+    testRadiusQuery(SPLIT_QUADRATIC);
+    testRadiusQuery(SPLIT_RSTAR);
+    testNearestNeighbors(SPLIT_LINEAR);
+    testNearestNeighbors(SPLIT_QUADRATIC);
+    testNearestNeighbors(SPLIT_RSTAR);
+    testFilteredQueries(SPLIT_LINEAR);
+    testFilteredQueries(SPLIT_QUADRATIC);
+    testFilteredQueries(SPLIT_RSTAR);
+    testConcurrentReadersAndWriter();
+    testHistoryGaps();
+    testHistoryExtremes();
+    testMultiRangeQuery();
+    testSpatialJoinZones();
+    testRasterize();
+    testSpatialJoinTrees();
+    testRemoveStandingQuery();
+    testSnapshotRoundTrip();
+    testSensorFileParsing();
+    testServerUpdate();
+    testSocketServer();
+
+    printf("%d checks, %d failed\n", checks_run, checks_failed);
+    return checks_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}